@@ -1,7 +1,5 @@
 #pragma once
 
-#include <boost/assert.hpp>
-
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <WinSock2.h>
 #pragma comment(lib, "WS2_32.lib")
@@ -13,8 +11,8 @@
 
 using namespace reader;
 
-template<typename T>
-void print(const std::map<unsigned int, T>& map,
+template<typename Map>
+void print(const Map& map,
 	const std::map<unsigned int, std::string>& dictionary = std::map<unsigned int, std::string>())
 {
 	for (const auto& entry : map)
@@ -26,40 +24,9 @@ void print(const std::map<unsigned int, T>& map,
 	}
 }
 
-void unit_tests(class statistics& image_recog)
-{
-	{
-		image_recog.update("german", image_recognition::load_image("test_screenshots/screenshot0082.jpg"));
-		const auto result = image_recog.get_population_amount();
-		BOOST_ASSERT(result.at(51904) == 981);
-		BOOST_ASSERT(result.at(51903) == 4090);
-		BOOST_ASSERT(result.at(51902) == 1862);
-		BOOST_ASSERT(result.at(51901) == 343);
-		BOOST_ASSERT(result.at(51911) == 1164);
-		BOOST_ASSERT(result.at(51910) == 725);
-		BOOST_ASSERT(result.at(51909) == 675);
-		
-	}
-	{
-		image_recog.update("german", image_recognition::load_image("test_screenshots/screenshot0093.jpg"));
-		const auto result = image_recog.get_population_amount();
-		BOOST_ASSERT(result.at(51904) == 0);
-		BOOST_ASSERT(result.at(51903) == 925);
-		BOOST_ASSERT(result.at(51902) == 651);
-		BOOST_ASSERT(result.at(51901) == 134);
-		BOOST_ASSERT(result.at(51911) == 112);
-		BOOST_ASSERT(result.at(51910) == 0);
-		BOOST_ASSERT(result.at(51909) == 600);
-
-	}
-
-	std::cout << "all tests passed!" << std::endl;
-}
-
 int main(int argc, char** argv) {
 	image_recognition recog(true);
 	statistics image_recog(recog);
-	//unit_tests(image_recog);
 
 	cv::Mat src = image_recognition::load_image("test_screenshots/screenshot0098.jpg");
 
@@ -0,0 +1,332 @@
+#include "response_builder.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+bool response_builder::parse_format(const std::wstring& name, format& result)
+{
+	if (name.empty() || name.compare(L"json") == 0)
+		result = format::JSON;
+	else if (name.compare(L"msgpack") == 0)
+		result = format::MSGPACK;
+	else
+		return false;
+
+	return true;
+}
+
+const char* response_builder::content_type(format f)
+{
+	return f == format::MSGPACK ? "application/msgpack" : "application/json";
+}
+
+const std::string& response_builder::build(format f,
+	const std::string& version,
+	const std::string& island_name,
+	const guid_map& population,
+	const guid_map& buildings,
+	const guid_map& productivities,
+	const pending_map& pending)
+{
+	begin_document(f);
+
+	unsigned int size = 1;
+	write_key("version");
+	write_value(version);
+
+	if (!island_name.empty())
+	{
+		write_key("islandName");
+		write_value(island_name);
+		size++;
+	}
+
+	if (!pending.empty())
+	{
+		write_key("pending");
+		begin_map(pending.size());
+		for (const auto& entry : pending)
+		{
+			write_key(entry.first.c_str());
+			write_value(entry.second);
+		}
+		end_map();
+		size++;
+	}
+
+	// without island the maps are empty unless the island was not requested
+	size += write_entries(population, buildings, productivities);
+
+	end_document(size);
+	return buffer;
+}
+
+const std::string& response_builder::build_delta(format f,
+	const guid_delta& population,
+	const guid_delta& buildings,
+	const guid_delta& productivities)
+{
+	begin_document(f);
+	end_document(write_entries(population, buildings, productivities));
+	return buffer;
+}
+
+response_builder::guid_delta response_builder::diff(const guid_map& previous, const guid_map& current)
+{
+	guid_delta result;
+	auto old_iter = previous.begin();
+	auto new_iter = current.begin();
+
+	while (old_iter != previous.end() || new_iter != current.end())
+	{
+		if (new_iter == current.end() || (old_iter != previous.end() && old_iter->first < new_iter->first))
+		{
+			result.emplace_hint(result.end(), old_iter->first, std::nullopt);
+			++old_iter;
+		}
+		else if (old_iter == previous.end() || new_iter->first < old_iter->first)
+		{
+			result.emplace_hint(result.end(), new_iter->first, new_iter->second);
+			++new_iter;
+		}
+		else
+		{
+			if (old_iter->second != new_iter->second)
+				result.emplace_hint(result.end(), new_iter->first, new_iter->second);
+			++old_iter;
+			++new_iter;
+		}
+	}
+
+	return result;
+}
+
+template<typename Map>
+unsigned int response_builder::write_entries(const Map& population, const Map& buildings, const Map& productivities)
+{
+	auto pop = population.begin();
+	auto bld = buildings.begin();
+	auto prod = productivities.begin();
+
+	unsigned int entries = 0;
+
+	while (pop != population.end() || bld != buildings.end() || prod != productivities.end())
+	{
+		unsigned int guid = std::numeric_limits<unsigned int>::max();
+		if (pop != population.end())
+			guid = std::min(guid, pop->first);
+		if (bld != buildings.end())
+			guid = std::min(guid, bld->first);
+		if (prod != productivities.end())
+			guid = std::min(guid, prod->first);
+
+		const bool has_pop = pop != population.end() && pop->first == guid;
+		const bool has_bld = bld != buildings.end() && bld->first == guid;
+		const bool has_prod = prod != productivities.end() && prod->first == guid;
+
+		write_key(guid);
+		begin_map(has_pop + has_bld + has_prod);
+		if (has_pop)
+		{
+			write_key("amount");
+			write_value((pop++)->second);
+		}
+		if (has_bld)
+		{
+			write_key("existingBuildings");
+			write_value((bld++)->second);
+		}
+		if (has_prod)
+		{
+			write_key("percentBoost");
+			write_value((prod++)->second);
+		}
+		end_map();
+
+		entries++;
+	}
+
+	return entries;
+}
+
+void response_builder::begin_document(format f)
+{
+	current_format = f;
+	buffer.clear();
+
+	if (f == format::MSGPACK)
+	{
+		// map 32 with a placeholder for the size
+		buffer.push_back(static_cast<char>(0xdf));
+		buffer.append(4, '\0');
+	}
+	else
+		begin_map(0);
+}
+
+void response_builder::end_document(unsigned int size)
+{
+	if (current_format == format::MSGPACK)
+	{
+		for (int i = 0; i < 4; i++)
+			buffer[1 + i] = static_cast<char>((size >> (8 * (3 - i))) & 0xff);
+	}
+	else
+		end_map();
+}
+
+void response_builder::begin_map(size_t size)
+{
+	if (current_format == format::JSON)
+	{
+		buffer.push_back('{');
+		first_in_map = true;
+		return;
+	}
+
+	if (size < 16)
+		buffer.push_back(static_cast<char>(0x80 | size));
+	else if (size <= 0xffff)
+	{
+		buffer.push_back(static_cast<char>(0xde));
+		write_big_endian(size, 2);
+	}
+	else
+	{
+		buffer.push_back(static_cast<char>(0xdf));
+		write_big_endian(size, 4);
+	}
+}
+
+void response_builder::end_map()
+{
+	if (current_format == format::JSON)
+	{
+		buffer.push_back('}');
+		first_in_map = false;
+	}
+}
+
+void response_builder::write_key(const char* key)
+{
+	if (current_format == format::JSON)
+	{
+		if (!first_in_map)
+			buffer.push_back(',');
+		first_in_map = false;
+
+		buffer.push_back('"');
+		buffer.append(key);
+		buffer.append("\":");
+	}
+	else
+		write_msgpack_string(key, std::char_traits<char>::length(key));
+}
+
+void response_builder::write_key(unsigned int guid)
+{
+	if (current_format == format::JSON)
+	{
+		if (!first_in_map)
+			buffer.push_back(',');
+		first_in_map = false;
+
+		char digits[16];
+		auto end = std::to_chars(digits, digits + sizeof(digits), guid).ptr;
+		buffer.push_back('"');
+		buffer.append(digits, end);
+		buffer.append("\":");
+	}
+	else
+	{
+		buffer.push_back(static_cast<char>(0xce));
+		write_big_endian(guid, 4);
+	}
+}
+
+void response_builder::write_value(const std::string& value)
+{
+	if (current_format == format::JSON)
+		write_json_string(value.data(), value.data() + value.size());
+	else
+		write_msgpack_string(value.data(), value.size());
+}
+
+void response_builder::write_value(int value)
+{
+	if (current_format == format::JSON)
+	{
+		char digits[16];
+		auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+		buffer.append(digits, end);
+	}
+	else
+	{
+		buffer.push_back(static_cast<char>(0xd2));
+		write_big_endian(static_cast<unsigned int>(value), 4);
+	}
+}
+
+void response_builder::write_value(const std::optional<int>& value)
+{
+	if (value)
+		write_value(*value);
+	else if (current_format == format::JSON)
+		buffer.append("null");
+	else
+		buffer.push_back(static_cast<char>(0xc0));
+}
+
+void response_builder::write_json_string(const char* begin, const char* end)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	buffer.push_back('"');
+	for (const char* c = begin; c != end; ++c)
+	{
+		const unsigned char u = static_cast<unsigned char>(*c);
+		if (u == '"' || u == '\\')
+		{
+			buffer.push_back('\\');
+			buffer.push_back(*c);
+		}
+		else if (u < 0x20)
+		{
+			buffer.append("\\u00");
+			buffer.push_back(hex[u >> 4]);
+			buffer.push_back(hex[u & 0xf]);
+		}
+		else
+			buffer.push_back(*c); // UTF-8 is passed through
+	}
+	buffer.push_back('"');
+}
+
+void response_builder::write_msgpack_string(const char* begin, size_t size)
+{
+	if (size < 32)
+		buffer.push_back(static_cast<char>(0xa0 | size));
+	else if (size <= 0xff)
+	{
+		buffer.push_back(static_cast<char>(0xd9));
+		write_big_endian(size, 1);
+	}
+	else if (size <= 0xffff)
+	{
+		buffer.push_back(static_cast<char>(0xda));
+		write_big_endian(size, 2);
+	}
+	else
+	{
+		buffer.push_back(static_cast<char>(0xdb));
+		write_big_endian(size, 4);
+	}
+	buffer.append(begin, size);
+}
+
+void response_builder::write_big_endian(unsigned long long value, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--)
+		buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
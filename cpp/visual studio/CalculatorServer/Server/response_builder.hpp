@@ -0,0 +1,98 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <string>
+
+#include "../reader/reader_guid_index.hpp"
+
+/*
+* Serializes recognition results without building an intermediate web::json::value.
+* The entries of the population, building and productivity maps are merged by GUID
+* in a single pass over their sorted keys and written to a buffer that is reused
+* between calls.
+*
+* Document layout (identical for both formats):
+* { "version": ..., "islandName": ..., "pending": { ... }, "<guid>": { "amount": ..., "existingBuildings": ..., "percentBoost": ... }, ... }
+* In MessagePack GUIDs are written as unsigned integer keys.
+* Keys of values that were not requested or not found are omitted.
+* "pending" is only present in partial responses, see pending_map.
+*/
+class response_builder
+{
+public:
+	enum class format
+	{
+		JSON,
+		MSGPACK
+	};
+
+	/* results are converted back to GUIDs only here */
+	typedef reader::guid_values guid_map;
+	/* changed entries, std::nullopt marks a removed value */
+	typedef std::map<unsigned int, std::optional<int>> guid_delta;
+	/* fields not completely read before the deadline, mapped to the number of boxes left */
+	typedef std::map<std::string, int> pending_map;
+
+	/*
+	* Parses the value of the format= query parameter ("json", "msgpack")
+	* Returns false for unknown formats
+	*/
+	static bool parse_format(const std::wstring& name, format& result);
+
+	static const char* content_type(format f);
+
+	/*
+	* Writes the complete response document
+	* Returns the internal buffer which is valid until the next call
+	*/
+	const std::string& build(format f,
+		const std::string& version,
+		const std::string& island_name,
+		const guid_map& population,
+		const guid_map& buildings,
+		const guid_map& productivities,
+		const pending_map& pending = pending_map());
+
+	/*
+	* Writes only the entries contained in the delta maps
+	*/
+	const std::string& build_delta(format f,
+		const guid_delta& population,
+		const guid_delta& buildings,
+		const guid_delta& productivities);
+
+	/*
+	* Returns the entries of @param{current} that differ from @param{previous}
+	*/
+	static guid_delta diff(const guid_map& previous, const guid_map& current);
+
+private:
+	/*
+	* Writes one entry per GUID, returns the number of entries
+	*/
+	template<typename Map>
+	unsigned int write_entries(const Map& population, const Map& buildings, const Map& productivities);
+
+	/* the size of the top level map is only known at the end */
+	void begin_document(format f);
+	void end_document(unsigned int size);
+
+	void begin_map(size_t size);
+	void end_map();
+	void write_key(const char* key);
+	void write_key(unsigned int guid);
+	void write_value(const std::string& value);
+	void write_value(int value);
+	void write_value(const std::optional<int>& value);
+
+	void write_json_string(const char* begin, const char* end);
+	void write_msgpack_string(const char* begin, size_t size);
+	void write_big_endian(unsigned long long value, int bytes);
+
+	format current_format = format::JSON;
+	std::string buffer;
+
+	/* JSON: whether the next key needs a preceding comma */
+	bool first_in_map = true;
+};
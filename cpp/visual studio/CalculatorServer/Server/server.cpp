@@ -1,5 +1,14 @@
 #include "server.hpp"
 
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "reader_assets.hpp"
+#include "reader_metrics.hpp"
+#include "reader_trace.hpp"
 #include "version.hpp"
 
 using namespace std;
@@ -11,145 +20,998 @@ using namespace web::http::experimental::listener;
 using namespace reader;
 
 
+const unsigned int server::max_waiters = 16;
+const std::chrono::milliseconds server::wait_timeout = std::chrono::milliseconds(10000);
+const std::chrono::milliseconds server::disconnect_poll_interval = std::chrono::milliseconds(50);
+const std::chrono::milliseconds server::capture_interval = std::chrono::milliseconds(1000);
+const float server::jump_threshold = 0.5f;
+const int server::jump_min_absolute = 10;
+const std::chrono::milliseconds server::reload_interval = std::chrono::milliseconds(2000);
+const unsigned int server::stage_threads = 3;
+const unsigned int server::max_contexts = 4;
+const std::chrono::milliseconds server::snapshot_max_age = std::chrono::milliseconds(1000);
+const std::chrono::milliseconds server::max_deadline = std::chrono::milliseconds(60000);
+
+server::recognition_context::recognition_context(std::shared_ptr<const assets> model,
+	bool verbose,
+	const std::string& window_regex,
+	std::shared_ptr<thread_pool> stage_pool)
+	:
+	recog(std::move(model), verbose, window_regex),
+	stats(recog, std::move(stage_pool))
+{
+}
 
 server::server(bool verbose)
 	:
-	recog(verbose),
-	stats(recog)
+	verbose(verbose),
+	ocr_timeout(image_recognition::default_ocr_timeout),
+	model(assets::load(verbose)),
+	stage_pool(std::make_shared<thread_pool>(stage_threads)),
+	recognition_executor(std::make_unique<thread_pool>(max_contexts))
 {
+	release_context(acquire_context());
 }
 
-server::server(bool verbose, std::wstring window_regex, utility::string_t url) :
-	recog(verbose, image_recognition::to_string(window_regex)),
-	stats(recog),
+server::server(bool verbose, std::wstring window_regex, utility::string_t url, std::chrono::milliseconds ocr_timeout) :
+	verbose(verbose),
+	window_regex(image_recognition::to_string(window_regex)),
+	ocr_timeout(ocr_timeout),
+	model(assets::load(verbose)),
+	stage_pool(std::make_shared<thread_pool>(stage_threads)),
+	recognition_executor(std::make_unique<thread_pool>(max_contexts)),
 	m_listener(url)
 {
+	if (verbose)
+		recorder = std::make_unique<flight_recorder>();
+
+	// the first context is created up front, further ones on demand
+	release_context(acquire_context());
+
 	m_listener.support(methods::GET, std::bind(&server::handle_get, this, std::placeholders::_1));
+	capture_thread = std::thread(&server::capture_loop, this);
+	watch_thread = std::thread(&server::watch_assets, this);
+	timeout_thread = std::thread(&server::expire_timeouts, this);
 }
 
+server::~server()
+{
+	{
+		std::lock_guard<std::mutex> lock(subscribers_mutex);
+		shutting_down = true;
+	}
+	subscribers_changed.notify_all();
+
+	if (capture_thread.joinable())
+		capture_thread.join();
+	if (watch_thread.joinable())
+		watch_thread.join();
+	if (timeout_thread.joinable())
+		timeout_thread.join();
+
+	// queued recognitions stop at their next check of the token
+	cancel_flights();
+
+	// finishes the queued recognitions while all members are alive
+	recognition_executor.reset();
 
-void server::read_anno_population(web::json::value& result)
+	// the continuations of handle_population reply on pplx threads once their flight completed
+	std::unique_lock<std::mutex> lock(flight_mutex);
+	replies_finished.wait(lock, [this]() { return pending_replies == 0; });
+}
+
+pplx::task<void> server::close()
 {
+	{
+		std::lock_guard<std::mutex> lock(subscribers_mutex);
+		shutting_down = true;
+	}
+	subscribers_changed.notify_all();
+
+	if (capture_thread.joinable())
+		capture_thread.join();
+	if (watch_thread.joinable())
+		watch_thread.join();
+	if (timeout_thread.joinable())
+		timeout_thread.join();
+
+	cancel_flights();
+
+	// handle_stream does not add clients once shutting_down is set
+	std::list<std::shared_ptr<subscriber>> clients;
+	{
+		std::lock_guard<std::mutex> lock(subscribers_mutex);
+		clients.swap(subscribers);
+	}
+
+	for (const auto& client : clients)
+	{
+		client->closed = true;
+		client->buffer.close(std::ios_base::out);
+	}
+
+	return m_listener.close();
+}
 
-	auto population = stats.get_population_amount();
 
-	for (const auto& p : population) {
-		web::json::value entry;
-		if (result.has_field(std::to_wstring(p.first)))
-			entry = result.at(std::to_wstring(p.first));
+const std::string& server::build(response_builder& builder, response_builder::format f, const recognition_result& result)
+{
+	return builder.build(f,
+		version::VERSION_TAG,
+		result.island_name,
+		result.population,
+		result.buildings,
+		result.productivities,
+		result.pending);
+}
+
+void server::serialize(response_builder& builder, recognition_result& result)
+{
+	if (result.status != status_codes::OK)
+		return;
 
-		entry[std::wstring(L"amount")] = web::json::value(p.second);
-		result[std::to_wstring(p.first)] = entry;
+	result.body = build(builder, response_builder::format::JSON, result);
+
+	// 64 bit FNV-1a
+	std::uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : result.body)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
 	}
+
+	utility::ostringstream_t stream;
+	stream << U('"') << std::hex << std::setw(16) << std::setfill(U('0')) << hash << U('"');
+	result.etag = stream.str();
+}
+
+bool server::matches_etag(const http_request& request, const utility::string_t& etag)
+{
+	utility::string_t header;
+	if (etag.empty() || !request.headers().match(header_names::if_none_match, header))
+		return false;
+
+	std::vector<utility::string_t> tags;
+	boost::split(tags, header, [](utility::char_t c) { return c == U(','); });
+	for (auto& tag : tags)
+	{
+		boost::trim(tag);
+		if (boost::starts_with(tag, U("W/")))
+			tag.erase(0, 2);
+
+		if (tag == U("*") || tag == etag)
+			return true;
+	}
+
+	return false;
 }
 
-void server::read_buildings_count(web::json::value& result)
+void server::parse_parameters(const http_request& request, std::string& language, bool& optimal_productivity)
 {
+	const auto& query_params = request.absolute_uri().split_query(request.absolute_uri().query());
 
+	ucout << "request received: " << request.absolute_uri().query() << endl;
 
-	auto values = stats.get_assets_existing_buildings();
+	language = "english";
+	optimal_productivity = false;
+	if (!query_params.empty())
+	{
+		if (query_params.find(L"lang") != query_params.end())
+		{
+			std::string lang = image_recognition::to_string(query_params.find(L"lang")->second);
+			if (get_model()->has_language(lang) && image_recognition::tesseract_languages.count(lang))
+				language = lang;
+		}
+
+		if (query_params.find(L"optimalProductivity") != query_params.end())
+		{
+			std::wstring string = query_params.find(L"optimalProductivity")->second;
+			optimal_productivity = string.compare(L"true") == 0 || string.compare(L"1") == 0;
+		}
+
+	}
+}
 
-	for (const auto& p : values) {
-		web::json::value entry;
-		if (result.has_field(std::to_wstring(p.first)))
-			entry = result.at(std::to_wstring(p.first));
+field_set server::parse_fields(const http_request& request)
+{
+	std::vector<utility::string_t> names;
+
+	const auto path = uri::split_path(uri::decode(request.relative_uri().path()));
+	if (path.size() > 1)
+		names.push_back(path[1]);
+
+	const auto query_params = uri::split_query(request.absolute_uri().query());
+	const auto fields_param = query_params.find(U("fields"));
+	if (fields_param != query_params.end())
+	{
+		std::vector<utility::string_t> listed;
+		boost::split(listed, fields_param->second, [](utility::char_t c) { return c == U(','); });
+		names.insert(names.end(), listed.begin(), listed.end());
+	}
 
-		entry[std::wstring(L"existingBuildings")] = web::json::value(p.second);
-		result[std::to_wstring(p.first)] = entry;
+	if (names.empty())
+		return FIELD_ALL;
+
+	field_set result = 0;
+	for (auto& name : names)
+	{
+		boost::trim(name);
+		if (name == U("island"))
+			result |= FIELD_ISLAND;
+		else if (name == U("population"))
+			result |= FIELD_POPULATION;
+		else if (name == U("buildings"))
+			result |= FIELD_BUILDINGS;
+		else if (name == U("productivities"))
+			result |= FIELD_PRODUCTIVITIES;
+		else
+			throw std::invalid_argument("unknown field");
 	}
 
+	return result;
 }
 
-void server::read_productivity_statistics(web::json::value& result, bool optimal_productivity)
+std::chrono::milliseconds server::parse_deadline(const http_request& request)
 {
-	auto values = stats.get_average_productivities();
+	const auto query_params = uri::split_query(request.absolute_uri().query());
+	const auto deadline_param = query_params.find(U("deadline_ms"));
+	if (deadline_param == query_params.end())
+		return std::chrono::milliseconds::zero();
+
+	const utility::string_t& value = deadline_param->second;
+	if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](utility::char_t c) { return c >= U('0') && c <= U('9'); }))
+		throw std::invalid_argument("malformed deadline");
+
+	const std::chrono::milliseconds deadline(std::stoll(value));
+	if (deadline <= std::chrono::milliseconds::zero() || deadline > max_deadline)
+		throw std::invalid_argument("deadline out of range");
 
-	for (const auto& p : values) {
-		web::json::value entry;
-		if (result.has_field(std::to_wstring(p.first)))
-			entry = result.at(std::to_wstring(p.first));
+	return deadline;
+}
 
-		entry[std::wstring(L"percentBoost")] = web::json::value(p.second);
-		result[std::to_wstring(p.first)] = entry;
+server::recognition_result server::recognize(recognition_context& context, const std::string& language, bool optimal_productivity,
+	field_set fields,
+	std::chrono::milliseconds budget,
+	std::chrono::steady_clock::time_point deadline,
+	const pplx::cancellation_token& token)
+{
+	scoped_timer timer(stage::RECOGNITION);
+	image_recognition& recog = context.recog;
+	statistics& stats = context.stats;
+
+	recognition_result result;
+	result.language = language;
+	result.optimal_productivity = optimal_productivity;
+	result.fields = fields;
+	result.status = status_codes::ServiceUnavailable;
+	if (token.is_canceled())
+	{
+		metrics::get().increment(counter::RECOGNITIONS_CANCELED);
+		return result;
 	}
+
+	// keeps the parameters and the recorded frame
+	const auto fail = [&](status_code status) {
+		const auto frame_id = result.frame_id;
+		result = recognition_result();
+		result.language = language;
+		result.optimal_productivity = optimal_productivity;
+		result.fields = fields;
+		result.frame_id = frame_id;
+		result.status = status;
+	};
+
+	try {
+		cv::Rect2i window(recog.find_anno());
+		if (!window.area())
+		{
+			std::cout << "Couldn't take screenshot" << std::endl;
+			metrics::get().increment(counter::FRAMES_SKIPPED);
+			result.status = status_codes::NoContent;
+			return result;
+		}
+
+		cv::Mat screenshot(recog.take_screenshot(window));
+		result.timestamp = std::chrono::steady_clock::now();
+		if (recorder)
+			result.frame_id = recorder->record(screenshot);
+
+		// all clients disconnected while the screenshot was taken
+		if (token.is_canceled())
+		{
+			metrics::get().increment(counter::RECOGNITIONS_CANCELED);
+			return result;
+		}
+
+		if (deadline == std::chrono::steady_clock::time_point::max())
+			stats.update(language, screenshot, fields);
+		else
+		{
+			const auto key = std::make_tuple(language, optimal_productivity, fields, budget.count());
+			building_progress progress;
+			{
+				std::lock_guard<std::mutex> lock(progress_mutex);
+				progress = buildings_read[key];
+			}
+
+			// the HUD, title and island stages finish regardless, the building boxes stop at the deadline
+			stats.update(language, screenshot, fields, progress, deadline);
+
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			buildings_read[key] = std::move(progress);
+		}
+
+		if (stats.get_pending_boxes())
+			result.pending.emplace("buildings", static_cast<int>(stats.get_pending_boxes()));
+
+		result.island_name = stats.get_selected_island();
+
+		// values are only meaningful for a selected island, unless the client did not ask for it
+		if (!result.island_name.empty() || !(fields & FIELD_ISLAND))
+		{
+			result.population = stats.get_population_amount();
+			result.buildings = stats.get_assets_existing_buildings();
+			result.productivities = stats.get_average_productivities();
+		}
+
+		result.status = status_codes::OK;
+	}
+	catch (...)
+	{
+		fail(status_codes::InternalError);
+	}
+
+	return result;
 }
 
+std::shared_ptr<server::flight> server::request_recognition(const std::string& language, bool optimal_productivity, field_set fields,
+	std::chrono::milliseconds budget)
+{
+	std::shared_ptr<flight> started;
+	{
+		std::lock_guard<std::mutex> lock(flight_mutex);
+		if (flights_stopped)
+			return nullptr;
+
+		auto existing = flights.find(std::make_tuple(language, optimal_productivity, fields, budget.count()));
+
+		// a flight reading more fields answers this request as well, like a snapshot does
+		std::shared_ptr<flight> joined;
+		if (existing != flights.end() && !existing->second->cancellation.get_token().is_canceled())
+			joined = existing->second;
+		for (auto iter = flights.begin(); !joined && iter != flights.end(); ++iter)
+		{
+			const flight& candidate = *iter->second;
+			if (candidate.language == language && candidate.optimal_productivity == optimal_productivity &&
+				candidate.budget == budget && (candidate.fields & fields) == fields &&
+				candidate.waiters < max_waiters && !candidate.cancellation.get_token().is_canceled())
+				joined = iter->second;
+		}
+
+		if (joined)
+		{
+			if (joined->waiters >= max_waiters)
+				return nullptr;
 
-void server::handle_get(http_request request)
+			joined->waiters++;
+			metrics::get().increment(counter::CACHE_HITS);
+			return joined;
+		}
+
+		// a canceled flight is replaced, it cannot be resumed
+		if (existing == flights.end() && flights.size() >= max_contexts)
+			return nullptr;
+
+		started = std::make_shared<flight>();
+		started->language = language;
+		started->optimal_productivity = optimal_productivity;
+		started->fields = fields;
+		started->budget = budget;
+		started->deadline = budget.count() ? std::chrono::steady_clock::now() + budget : std::chrono::steady_clock::time_point::max();
+		started->result = pplx::create_task(started->completed);
+		started->waiters = 1;
+		flights[std::make_tuple(language, optimal_productivity, fields, budget.count())] = started;
+	}
+
+	recognition_executor->submit([this, started]() { run_flight(started); });
+	return started;
+}
+
+void server::leave(const std::shared_ptr<flight>& f)
+{
+	std::lock_guard<std::mutex> lock(flight_mutex);
+	if (f->waiters && --f->waiters == 0)
+		f->cancellation.cancel();
+}
+
+void server::cancel_flights()
+{
+	std::lock_guard<std::mutex> lock(flight_mutex);
+	flights_stopped = true;
+	for (const auto& entry : flights)
+		entry.second->cancellation.cancel();
+}
+
+void server::run_flight(const std::shared_ptr<flight>& f)
 {
-	if (mutex_.try_lock()) {
+	recognition_result recognized;
+	try {
+		context_lease context(*this);
+		recognized = recognize(*context, f->language, f->optimal_productivity, f->fields, f->budget, f->deadline, f->cancellation.get_token());
+		serialize(context->builder, recognized);
+	}
+	catch (...)
+	{
+		// e.g. a new context failed to initialize tesseract
+		recognized = recognition_result();
+		recognized.language = f->language;
+		recognized.optimal_productivity = f->optimal_productivity;
+		recognized.fields = f->fields;
+		recognized.status = status_codes::InternalError;
+	}
+
+	if (recognized.status != status_codes::ServiceUnavailable)
+		inspect(recognized);
+
+	const auto result = std::make_shared<const recognition_result>(std::move(recognized));
+	if (result->status == status_codes::OK && result->pending.empty())
+	{
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		snapshot = result;
+	}
+	f->completed.set(result);
+	{
+		std::lock_guard<std::mutex> lock(flight_mutex);
+		auto iter = flights.find(std::make_tuple(f->language, f->optimal_productivity, f->fields, f->budget.count()));
+		if (iter != flights.end() && iter->second == f)
+			flights.erase(iter);
+	}
+}
+
+std::shared_ptr<const server::recognition_result> server::get_snapshot(const std::string& language, bool optimal_productivity, field_set fields) const
+{
+	std::shared_ptr<const recognition_result> latest;
+	{
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		latest = snapshot;
+	}
+	if (!latest ||
+		latest->language != language ||
+		latest->optimal_productivity != optimal_productivity ||
+		(latest->fields & fields) != fields ||
+		std::chrono::steady_clock::now() - latest->timestamp > snapshot_max_age)
+		return nullptr;
+
+	return latest;
+}
+
+std::unique_ptr<server::recognition_context> server::acquire_context()
+{
+	std::unique_ptr<recognition_context> context;
+	{
+		std::unique_lock<std::mutex> lock(contexts_mutex, std::defer_lock);
+		{
+			trace_scope wait("wait_recognition_context");
+			lock.lock();
+			context_released.wait(lock, [this]() { return !idle_contexts.empty() || context_count < max_contexts; });
+		}
+
+		if (!idle_contexts.empty())
+		{
+			context = std::move(idle_contexts.back());
+			idle_contexts.pop_back();
+		}
+		else
+			context_count++;
+	}
+
+	const std::shared_ptr<const assets> current = get_model();
+	if (!context)
+	{
 		try {
-			const auto& query_params = request.absolute_uri().split_query(request.absolute_uri().query());
+			context = std::make_unique<recognition_context>(current, verbose, window_regex, stage_pool);
+			context->recog.set_ocr_timeout(ocr_timeout);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(contexts_mutex);
+			context_count--;
+			context_released.notify_one();
+			throw;
+		}
+	}
+	else if (&context->recog.get_assets() != current.get())
+	{
+		// the context is not in use, so no recognition holds references into the old assets
+		context->recog.set_assets(current);
+	}
 
-			ucout << "request received: " << request.absolute_uri().query() << endl;
+	return context;
+}
 
+server::context_lease::context_lease(server& owner)
+	:
+	owner(owner),
+	context(owner.acquire_context())
+{
+}
 
-			std::string language("english");
-			bool optimal_productivity = false;
-			if (!query_params.empty())
+server::context_lease::~context_lease()
+{
+	owner.release_context(std::move(context));
+}
+
+server::recognition_context& server::context_lease::operator*() const
+{
+	return *context;
+}
+
+server::recognition_context* server::context_lease::operator->() const
+{
+	return context.get();
+}
+
+void server::release_context(std::unique_ptr<recognition_context> context)
+{
+	{
+		std::lock_guard<std::mutex> lock(contexts_mutex);
+		idle_contexts.push_back(std::move(context));
+	}
+	context_released.notify_one();
+}
+
+void server::inspect(const recognition_result& result)
+{
+	if (!recorder || result.status == status_codes::NoContent)
+		return;
+
+	std::lock_guard<std::mutex> lock(inspect_mutex);
+
+	// failed before the screenshot was taken
+	if (result.frame_id)
+		recorder->annotate(result.frame_id, result.body);
+	if (frames_since_dump < recorder->get_capacity())
+		frames_since_dump++;
+
+	std::string reason;
+	if (result.status != status_codes::OK)
+		reason = "exception";
+	else if ((result.fields & FIELD_ISLAND) && result.island_name.empty())
+		reason = "no_island";
+	else if (result.fields == FIELD_ALL && result.pending.empty() && last_inspected && last_inspected->island_name == result.island_name &&
+		(jumped(last_inspected->population, result.population) || jumped(last_inspected->buildings, result.buildings)))
+		reason = "jump";
+
+	// partial results are not compared
+	if (result.status == status_codes::OK && result.fields == FIELD_ALL && result.pending.empty() && !result.island_name.empty())
+		last_inspected = std::make_shared<const recognition_result>(result);
+
+	// a persisting problem is dumped once per full buffer
+	if (!reason.empty() && frames_since_dump >= recorder->get_capacity())
+	{
+		recorder->dump(reason);
+		frames_since_dump = 0;
+	}
+}
+
+bool server::jumped(const guid_values& previous, const guid_values& current)
+{
+	for (const auto& entry : current)
+	{
+		if (!previous.count(entry.first))
+			continue;
+
+		const int before = previous.at(entry.first);
+		const int difference = std::abs(entry.second - before);
+		if (difference >= jump_min_absolute && difference > jump_threshold * std::abs(before))
+			return true;
+	}
+
+	return false;
+}
+
+void server::reply(const http_request& request, const recognition_result& result, response_builder::format f)
+{
+	// the etag identifies the content, the suffix the representation
+	utility::string_t etag = result.etag;
+	if (f != response_builder::format::JSON && !etag.empty())
+		etag.insert(etag.size() - 1, U("-msgpack"));
+
+	const bool not_modified = result.status == status_codes::OK && matches_etag(request, etag);
+	if (not_modified)
+		metrics::get().increment(counter::NOT_MODIFIED);
+
+	web::http::http_response response(not_modified ? status_codes::NotModified : result.status);
+	response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+	if (result.status == status_codes::OK)
+	{
+		response.headers().add(header_names::etag, etag);
+		response.headers().add(U("Access-Control-Expose-Headers"), header_names::etag);
+		if (!not_modified && f == response_builder::format::JSON)
+			response.set_body(result.body, response_builder::content_type(f));
+		else if (!not_modified)
+		{
+			response_builder binary_builder;
+			const std::string& body = build(binary_builder, f, result);
+			response.set_body(std::vector<unsigned char>(body.begin(), body.end()));
+			response.headers().set_content_type(utility::conversions::to_string_t(response_builder::content_type(f)));
+		}
+	}
+	const auto t = request.reply(response);
+}
+
+void server::handle_get(http_request request)
+{
+	const auto path = uri::split_path(uri::decode(request.relative_uri().path()));
+
+	if (path.empty() || path.front() == U("Population"))
+		handle_population(request);
+	else if (path.front() == U("Stream"))
+		handle_stream(request);
+	else if (path.front() == U("metrics"))
+		handle_metrics(request);
+	else if (path.front() == U("trace"))
+		handle_trace(request);
+	else
+	{
+		web::http::http_response response(status_codes::NotFound);
+		response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+		const auto t = request.reply(response);
+	}
+}
+
+void server::handle_population(http_request request)
+{
+	std::string language;
+	bool optimal_productivity;
+	field_set fields;
+	std::chrono::milliseconds budget;
+	response_builder::format format = response_builder::format::JSON;
+
+	try {
+		parse_parameters(request, language, optimal_productivity);
+		fields = parse_fields(request);
+		budget = parse_deadline(request);
+
+		const auto query_params = uri::split_query(request.absolute_uri().query());
+		const auto format_param = query_params.find(U("format"));
+		if (format_param != query_params.end() && !response_builder::parse_format(format_param->second, format))
+			throw std::invalid_argument("unknown format");
+	}
+	catch (...)
+	{
+		recognition_result result;
+		result.status = status_codes::BadRequest;
+		reply(request, result);
+		return;
+	}
+
+	// e.g. while the capture loop runs for subscribers of the stream
+	if (const auto recent = get_snapshot(language, optimal_productivity, fields))
+	{
+		metrics::get().increment(counter::SNAPSHOT_HITS);
+		reply(request, *recent, format);
+		return;
+	}
+
+	const auto f = request_recognition(language, optimal_productivity, fields, budget);
+	if (!f)
+	{
+		metrics::get().increment(counter::REQUESTS_REJECTED);
+		recognition_result rejected;
+		rejected.status = status_codes::TooManyRequests;
+		reply(request, rejected);
+		return;
+	}
+
+	// the listener thread returns to serve other requests, the response is sent by the continuation
+	// or by the timeout, whichever comes first
+	const auto waiting = std::make_shared<waiting_request>();
+	waiting->request = request;
+	{
+		std::lock_guard<std::mutex> lock(flight_mutex);
+		pending_replies++;
+	}
+	f->result.then([this, waiting, format](std::shared_ptr<const recognition_result> result)
+		{
+			if (!waiting->answered.exchange(true))
 			{
-				if (query_params.find(L"lang") != query_params.end())
-				{
-					std::string lang = image_recognition::to_string(query_params.find(L"lang")->second);
-					if (stats.has_language(lang))
-						language = lang;
+				try {
+					reply(waiting->request, *result, format);
 				}
-
-				if (query_params.find(L"optimalProductivity") != query_params.end())
+				catch (...)
 				{
-					std::wstring string = query_params.find(L"optimalProductivity")->second;
-					optimal_productivity = string.compare(L"true") == 0 || string.compare(L"1") == 0;
+					// e.g. the client disconnected meanwhile
 				}
-
 			}
 
+			std::lock_guard<std::mutex> lock(flight_mutex);
+			pending_replies--;
+			replies_finished.notify_all();
+		});
+
+	// e.g. find_anno or the screenshot hang
+	// the entry stays until it is due, but releases request and flight once the continuation ran
+	const std::weak_ptr<waiting_request> weak_waiting = waiting;
+	const std::weak_ptr<flight> weak_flight = f;
+	schedule_timeout(std::chrono::steady_clock::now() + wait_timeout, [this, weak_waiting, weak_flight]()
+		{
+			const auto waiting = weak_waiting.lock();
+			const auto f = weak_flight.lock();
+			if (!waiting || !f || waiting->answered.exchange(true))
+				return;
 
+			leave(f);
+			metrics::get().increment(counter::REQUESTS_TIMED_OUT);
 
-			cv::Rect2i window(recog.find_anno());
-			if (!window.area())
+			try {
+				recognition_result timed_out;
+				timed_out.status = status_codes::ServiceUnavailable;
+				reply(waiting->request, timed_out);
+			}
+			catch (...)
 			{
-				std::cout << "Couldn't take screenshot" << std::endl;
-				web::http::http_response response(status_codes::NoContent);
-				response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
-				const auto t = request.reply(response);
-				mutex_.unlock();
-				return;
 			}
+		});
+};
+
+void server::handle_metrics(http_request request)
+{
+	web::http::http_response response(status_codes::OK);
+	response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+	response.set_body(metrics::get().to_prometheus(), "text/plain; version=0.0.4");
+	const auto t = request.reply(response);
+}
+
+void server::handle_trace(http_request request)
+{
+	web::http::http_response response(trace::get().enabled ? status_codes::OK : status_codes::NotFound);
+	response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+	if (trace::get().enabled)
+		response.set_body(trace::get().to_json(), "application/json");
+	const auto t = request.reply(response);
+}
+
+void server::handle_stream(http_request request)
+{
+	auto client = std::make_shared<subscriber>();
+
+	try {
+		parse_parameters(request, client->language, client->optimal_productivity);
+	}
+	catch (...)
+	{
+		recognition_result result;
+		result.status = status_codes::BadRequest;
+		reply(request, result);
+		return;
+	}
+
+	web::http::http_response response(status_codes::OK);
+	response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+	response.headers().add(U("Cache-Control"), U("no-cache"));
+	response.headers().set_content_type(U("text/event-stream"));
+	response.set_body(client->buffer.create_istream());
+
+	// the reply completes when the stream is closed or the client disconnects
+	request.reply(response).then([client](pplx::task<void> t)
+		{
+			try { t.get(); }
+			catch (...) {}
+			client->closed = true;
+		});
+
+	// the client is not yet visible to the capture loop, which continues with deltas to this result
+	if (const auto recent = get_snapshot(client->language, client->optimal_productivity, FIELD_ALL))
+	{
+		try {
+			publish(*client, recent);
+		}
+		catch (...)
+		{
+			client->closed = true;
+		}
+	}
+
+	bool added = false;
+	{
+		std::lock_guard<std::mutex> lock(subscribers_mutex);
+		if (!shutting_down)
+		{
+			subscribers.push_back(client);
+			added = true;
+		}
+	}
+
+	// the server shuts down, close() does not see this client to end its stream
+	if (!added)
+		client->buffer.close(std::ios_base::out);
+	else
+		subscribers_changed.notify_all();
+}
+
+void server::publish(subscriber& client, const std::shared_ptr<const recognition_result>& result)
+{
+	std::string data;
+
+	if (!client.last || client.last->island_name != result->island_name)
+	{
+		data = "event: snapshot\ndata: " + result->body + "\n\n";
+	}
+	else
+	{
+		auto population = response_builder::diff(client.last->population, result->population);
+		auto buildings = response_builder::diff(client.last->buildings, result->buildings);
+		auto productivities = response_builder::diff(client.last->productivities, result->productivities);
+
+		if (population.empty() && buildings.empty() && productivities.empty())
+			return;
 
-			cv::Mat screenshot(recog.take_screenshot(window));
-			stats.update(language, screenshot);
+		data = "event: delta\ndata: " + stream_builder.build_delta(response_builder::format::JSON, population, buildings, productivities) + "\n\n";
+	}
 
-			web::json::value json_message;
+	client.last = result;
 
-			json_message[U("version")] = web::json::value(std::wstring(version::VERSION_TAG.begin(), version::VERSION_TAG.end()));
-			std::string island_name = stats.get_selected_island();
+	client.buffer.putn_nocopy(reinterpret_cast<const uint8_t*>(data.data()), data.size()).wait();
+	client.buffer.sync().wait();
+}
 
-			if (!island_name.empty())
+void server::capture_loop()
+{
+	std::unique_lock<std::mutex> lock(subscribers_mutex);
+
+	while (!shutting_down)
+	{
+		subscribers_changed.wait(lock, [this]() { return shutting_down || !subscribers.empty(); });
+		if (shutting_down)
+			break;
+
+		const auto next_capture = std::chrono::steady_clock::now() + capture_interval;
+
+		subscribers.remove_if([](const std::shared_ptr<subscriber>& client) { return client->closed.load(); });
+		std::list<std::shared_ptr<subscriber>> clients(subscribers);
+		lock.unlock();
+
+		// one recognition per distinct parameter set
+		while (!clients.empty())
+		{
+			const std::string language = clients.front()->language;
+			const bool optimal_productivity = clients.front()->optimal_productivity;
+
+			const auto f = request_recognition(language, optimal_productivity, FIELD_ALL);
+			std::shared_ptr<const recognition_result> result;
+			if (f)
 			{
-				json_message[U("islandName")] = web::json::value(image_recognition::to_wstring(island_name));
+				// leaves the recognition if all its clients disconnect before it finished
+				const auto deadline = std::chrono::steady_clock::now() + wait_timeout;
+				while (!f->result.is_done() && std::chrono::steady_clock::now() < deadline &&
+					std::any_of(clients.begin(), clients.end(), [&](const std::shared_ptr<subscriber>& client) {
+						return client->language == language && client->optimal_productivity == optimal_productivity && !client->closed;
+					}))
+					std::this_thread::sleep_for(disconnect_poll_interval);
+
+				if (f->result.is_done())
+					result = f->result.get();
+				else
+					leave(f);
+			}
 
-				read_anno_population(json_message);
-				read_buildings_count(json_message);
-				read_productivity_statistics(json_message, optimal_productivity);
+			for (auto iter = clients.begin(); iter != clients.end();)
+			{
+				if ((*iter)->language != language || (*iter)->optimal_productivity != optimal_productivity)
+				{
+					++iter;
+					continue;
+				}
+
+				try {
+					if (result && result->status == status_codes::OK && !(*iter)->closed)
+						publish(**iter, result);
+				}
+				catch (...)
+				{
+					(*iter)->closed = true;
+				}
+
+				if ((*iter)->closed)
+					(*iter)->buffer.close(std::ios_base::out);
+				iter = clients.erase(iter);
 			}
+		}
+
+		lock.lock();
+		subscribers_changed.wait_until(lock, next_capture, [this]() { return shutting_down; });
+	}
+}
 
+void server::schedule_timeout(std::chrono::steady_clock::time_point deadline, std::function<void()> expire)
+{
+	bool earliest;
+	{
+		std::lock_guard<std::mutex> lock(subscribers_mutex);
+		if (shutting_down)
+			return;
+
+		earliest = timeouts.empty() || deadline < timeouts.begin()->first;
+		timeouts.emplace(deadline, std::move(expire));
+	}
 
-			web::http::http_response response(status_codes::OK);
-			response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
-			response.set_body(json_message);
-			const auto t = request.reply(response);
-		} catch(...)
+	if (earliest)
+		subscribers_changed.notify_all();
+}
+
+void server::expire_timeouts()
+{
+	std::unique_lock<std::mutex> lock(subscribers_mutex);
+	while (!shutting_down)
+	{
+		if (timeouts.empty())
+			subscribers_changed.wait(lock, [this]() { return shutting_down || !timeouts.empty(); });
+		else
+			subscribers_changed.wait_until(lock, timeouts.begin()->first);
+		if (shutting_down)
+			break;
+
+		std::vector<std::function<void()>> due;
+		const auto now = std::chrono::steady_clock::now();
+		while (!timeouts.empty() && timeouts.begin()->first <= now)
 		{
-			web::http::http_response response(status_codes::InternalError);
-			response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
-			const auto t = request.reply(response);
+			due.push_back(std::move(timeouts.begin()->second));
+			timeouts.erase(timeouts.begin());
 		}
+		lock.unlock();
 
-		mutex_.unlock();
+		for (const auto& expire : due)
+			expire();
+
+		lock.lock();
 	}
-	else {
-		web::http::http_response response(status_codes::TooManyRequests);
-		response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
-		const auto t = request.reply(response);
+
+	timeouts.clear();
+}
+
+std::shared_ptr<const assets> server::get_model() const
+{
+	std::lock_guard<std::mutex> lock(model_mutex);
+	return model;
+}
+
+void server::watch_assets()
+{
+	// state of the files when loading them failed last time, retried only once they change again
+	std::vector<assets::source> failed;
+
+	std::unique_lock<std::mutex> lock(subscribers_mutex);
+	while (!shutting_down)
+	{
+		subscribers_changed.wait_for(lock, reload_interval, [this]() { return shutting_down; });
+		if (shutting_down)
+			break;
+		lock.unlock();
+
+		const std::shared_ptr<const assets> current = get_model();
+		std::vector<assets::source> sources = current->stamp_sources();
+		if (sources != current->sources && sources != failed)
+		{
+			try {
+				// running recognitions keep the old version, contexts switch when they are acquired next
+				std::shared_ptr<const assets> loaded = assets::load_json(verbose);
+				{
+					std::lock_guard<std::mutex> lock(model_mutex);
+					model = std::move(loaded);
+				}
+				failed.clear();
+
+				std::cout << "Reloaded texts and icons." << std::endl;
+			}
+			catch (const std::exception& e)
+			{
+				// e.g. a file is still being written
+				failed = std::move(sources);
+				std::cout << "Reloading texts and icons failed: " << e.what() << std::endl;
+			}
+		}
+
+		lock.lock();
 	}
-};
\ No newline at end of file
+}
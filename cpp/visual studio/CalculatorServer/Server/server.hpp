@@ -1,12 +1,27 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 
 #include "cpprest/json.h"
 #include "cpprest/http_listener.h"
+#include "cpprest/producerconsumerstream.h"
 
+#include "../reader/reader_flight_recorder.hpp"
 #include "../reader/reader_statistics.hpp"
+#include "response_builder.hpp"
 
 using namespace web;
 using namespace http;
@@ -17,20 +32,335 @@ class server
 {
 public:
 	server(bool verbose);
-	server(bool verbose, std::wstring window_regex, utility::string_t url);
+	/*
+	* @param{ocr_timeout} limits every tesseract call of a recognition, a crop that takes longer is unreadable
+	*/
+	server(bool verbose, std::wstring window_regex, utility::string_t url,
+		std::chrono::milliseconds ocr_timeout = reader::image_recognition::default_ocr_timeout);
+	~server();
 
 	pplx::task<void> open() { return m_listener.open(); }
-	pplx::task<void> close() { return m_listener.close(); }
+	pplx::task<void> close();
+
+	/* maximal number of requests that wait for a recognition in progress */
+	static const unsigned int max_waiters;
+	/* maximal time a request or the capture loop waits for a recognition before it leaves it */
+	static const std::chrono::milliseconds wait_timeout;
+	/* time between two checks of the capture loop whether its clients are still connected */
+	static const std::chrono::milliseconds disconnect_poll_interval;
+	/* time between two recognitions while clients are subscribed to the stream */
+	static const std::chrono::milliseconds capture_interval;
+	/* relative change of a value on the same island that triggers a flight recorder dump */
+	static const float jump_threshold;
+	/* changes below this absolute value never trigger a dump */
+	static const int jump_min_absolute;
+	/* time between two checks whether texts or icons changed on disk */
+	static const std::chrono::milliseconds reload_interval;
+	/* threads running independent stages of recognitions concurrently, shared by all contexts */
+	static const unsigned int stage_threads;
+	/* maximal number of recognitions (with distinct parameters) running in parallel */
+	static const unsigned int max_contexts;
+	/* maximal age of a published result that is served without a new recognition */
+	static const std::chrono::milliseconds snapshot_max_age;
+	/* largest accepted value of the deadline_ms query parameter */
+	static const std::chrono::milliseconds max_deadline;
 
 private:
-	void read_anno_population(web::json::value& result);
-	void read_buildings_count(web::json::value& result);
-	void read_productivity_statistics(web::json::value& result, bool optimalProductivity);
+	struct recognition_result
+	{
+		status_code status;
+		std::string island_name;
+		reader::guid_values population;
+		reader::guid_values buildings;
+		reader::guid_values productivities;
+
+		/* parameters of the recognition */
+		std::string language;
+		bool optimal_productivity = false;
+		reader::field_set fields = reader::FIELD_ALL;
+		/* when the screenshot was taken */
+		std::chrono::steady_clock::time_point timestamp;
+
+		/* flight recorder frame, 0 if none was recorded */
+		unsigned long long frame_id = 0;
+
+		/* values left unread when the deadline passed, empty for complete results */
+		response_builder::pending_map pending;
+
+		/* serialized JSON response and its content hash, computed once per recognition */
+		std::string body;
+		utility::string_t etag;
+	};
+
+	/*
+	* State of one recognition, taken from the pool while it runs.
+	* The game data is shared by all contexts.
+	*/
+	struct recognition_context
+	{
+		recognition_context(std::shared_ptr<const reader::assets> model,
+			bool verbose,
+			const std::string& window_regex,
+			std::shared_ptr<reader::thread_pool> stage_pool);
+
+		reader::image_recognition recog;
+		reader::statistics stats;
+		/* serializes the results of this context */
+		response_builder builder;
+	};
+
+	/*
+	* Takes a context from the pool and returns it when it goes out of scope,
+	* also if the recognition or the serialization throws
+	*/
+	class context_lease
+	{
+	public:
+		explicit context_lease(server& owner);
+		~context_lease();
+
+		context_lease(const context_lease&) = delete;
+		context_lease& operator=(const context_lease&) = delete;
+
+		recognition_context& operator*() const;
+		recognition_context* operator->() const;
+
+	private:
+		server& owner;
+		std::unique_ptr<recognition_context> context;
+	};
+
+	/*
+	* A recognition in progress. Requests with the same parameters, or a subset of its fields,
+	* that arrive meanwhile attach to it instead of starting their own.
+	*/
+	struct flight
+	{
+		std::string language;
+		bool optimal_productivity;
+		reader::field_set fields;
+		/* zero for recognitions without deadline */
+		std::chrono::milliseconds budget;
+		std::chrono::steady_clock::time_point deadline;
+		pplx::task_completion_event<std::shared_ptr<const recognition_result>> completed;
+		/* completes on the recognition executor, waiters attach continuations */
+		pplx::task<std::shared_ptr<const recognition_result>> result;
+		/* canceled once all waiters left */
+		pplx::cancellation_token_source cancellation;
+		/* requests and the capture loop waiting for the result, guarded by flight_mutex */
+		unsigned int waiters = 0;
+	};
+
+	/*
+	* A request of handle_population waiting for a flight. Owned by the continuation,
+	* the timeout only holds a weak reference so that it does not keep an answered request alive.
+	*/
+	struct waiting_request
+	{
+		http_request request;
+		/* set by whichever of continuation and timeout replies first */
+		std::atomic<bool> answered{ false };
+	};
+
+	/*
+	* A client of the event stream, receives only the changes
+	* with respect to the last result sent to it.
+	*/
+	struct subscriber
+	{
+		std::string language;
+		bool optimal_productivity;
+		concurrency::streams::producer_consumer_buffer<uint8_t> buffer;
+		std::shared_ptr<const recognition_result> last;
+		std::atomic<bool> closed = false;
+	};
+
+	/*
+	* Writes @param{result} into @param{builder} in format @param{f}
+	*/
+	static const std::string& build(response_builder& builder, response_builder::format f, const recognition_result& result);
+
+	/*
+	* Sets body (JSON) and etag of @param{result}
+	*/
+	void serialize(response_builder& builder, recognition_result& result);
+
+	/*
+	* Returns whether the If-None-Match header of @param{request} matches @param{etag}
+	*/
+	static bool matches_etag(const http_request& request, const utility::string_t& etag);
+
+	/*
+	* Parses lang and optimalProductivity, throws on malformed queries
+	*/
+	void parse_parameters(const http_request& request, std::string& language, bool& optimal_productivity);
+
+	/*
+	* Returns the fields selected by the path (/Population/<field>) and the fields= query parameter
+	* (comma separated: island, population, buildings, productivities), all fields if neither is present.
+	* Throws on unknown names.
+	*/
+	static reader::field_set parse_fields(const http_request& request);
+
+	/*
+	* Returns the value of the deadline_ms query parameter, zero if it is absent.
+	* Throws if it is no number in (0, max_deadline].
+	*/
+	static std::chrono::milliseconds parse_deadline(const http_request& request);
+
+	/*
+	* Checks @param{token} before the screenshot and before the statistics are computed,
+	* a canceled recognition has status ServiceUnavailable.
+	* With a @param{deadline} the building counts are read until it passes and continue
+	* from the previous recognition with the same @param{budget}, the remainder is listed in pending.
+	*/
+	recognition_result recognize(recognition_context& context, const std::string& language, bool optimal_productivity,
+		reader::field_set fields,
+		std::chrono::milliseconds budget,
+		std::chrono::steady_clock::time_point deadline,
+		const pplx::cancellation_token& token = pplx::cancellation_token::none());
+
+	/*
+	* Returns an idle context or creates one, waits while max_contexts are in use.
+	* The context is updated to the current assets.
+	*/
+	std::unique_ptr<recognition_context> acquire_context();
+	void release_context(std::unique_ptr<recognition_context> context);
+
+	/*
+	* Starts a recognition on the recognition executor or attaches to the one in progress
+	* with the same parameters or, failing that, to one that reads a superset of @param{fields}.
+	* A @param{budget} of zero means no deadline, otherwise the deadline is counted from now.
+	* Returns nullptr if neither is possible. The caller counts as waiter of the flight.
+	*/
+	std::shared_ptr<flight> request_recognition(const std::string& language, bool optimal_productivity, reader::field_set fields,
+		std::chrono::milliseconds budget = std::chrono::milliseconds::zero());
+
+	/*
+	* Removes a waiter from @param{f}, the recognition is canceled when the last one left
+	*/
+	void leave(const std::shared_ptr<flight>& f);
+
+	/*
+	* Cancels all flights and rejects new ones, used on shutdown
+	*/
+	void cancel_flights();
+
+	/*
+	* Executed on the recognition executor, completes @param{f}
+	*/
+	void run_flight(const std::shared_ptr<flight>& f);
+
+	/*
+	* Returns the latest published result if it has the given parameters, contains at least
+	* the requested @param{fields} and is at most snapshot_max_age old, nullptr otherwise.
+	* Never waits for a recognition.
+	*/
+	std::shared_ptr<const recognition_result> get_snapshot(const std::string& language, bool optimal_productivity, reader::field_set fields) const;
+
+	/*
+	* Passes the result to the flight recorder and dumps the recent frames
+	* if the recognition failed, found no island or values jumped
+	*/
+	void inspect(const recognition_result& result);
+	static bool jumped(const reader::guid_values& previous, const reader::guid_values& current);
+
+	void reply(const http_request& request, const recognition_result& result,
+		response_builder::format f = response_builder::format::JSON);
 
 	void handle_get(http_request message);
+	void handle_population(http_request message);
+	void handle_stream(http_request message);
+	void handle_metrics(http_request message);
+	void handle_trace(http_request message);
+
+	void capture_loop();
+	void publish(subscriber& client, const std::shared_ptr<const recognition_result>& result);
+
+	/*
+	* Polls the files of the assets and publishes a new version,
+	* contexts switch to it before their next recognition
+	*/
+	void watch_assets();
+
+	/*
+	* Runs @param{expire} on timeout_thread at @param{deadline}, dropped if the server shuts down before
+	*/
+	void schedule_timeout(std::chrono::steady_clock::time_point deadline, std::function<void()> expire);
+
+	/*
+	* Executed on timeout_thread, runs the callbacks of timeouts once they are due
+	*/
+	void expire_timeouts();
+
+	std::shared_ptr<const reader::assets> get_model() const;
+
+	const bool verbose;
+	const std::string window_regex;
+	const std::chrono::milliseconds ocr_timeout;
+	mutable std::mutex model_mutex;
+	/* game data for new recognitions, replaced as a whole, guarded by model_mutex */
+	std::shared_ptr<const reader::assets> model;
+	std::shared_ptr<reader::thread_pool> stage_pool;
+
+	std::mutex contexts_mutex;
+	std::condition_variable context_released;
+	std::vector<std::unique_ptr<recognition_context>> idle_contexts;
+	/* idle and in use */
+	unsigned int context_count = 0;
+
+	/*
+	* One thread per context runs the recognitions, listener threads only attach
+	* continuations and are free for other requests meanwhile
+	*/
+	std::unique_ptr<reader::thread_pool> recognition_executor;
 
-	reader::image_recognition recog;
-	reader::statistics stats;
 	http_listener m_listener;
-	std::mutex mutex_;
-};
\ No newline at end of file
+
+	/* used by the capture thread */
+	response_builder stream_builder;
+
+	/* guards recorder (annotations and dumps), last_inspected and frames_since_dump */
+	std::mutex inspect_mutex;
+	/* only present in verbose mode */
+	std::unique_ptr<reader::flight_recorder> recorder;
+	/* last successful result passed to inspect */
+	std::shared_ptr<const recognition_result> last_inspected;
+	/* frames recorded since the last dump, starts full so that the first failure is dumped */
+	size_t frames_since_dump = std::numeric_limits<size_t>::max();
+
+	mutable std::mutex snapshot_mutex;
+	/*
+	* Latest successful result, replaced as a whole after every recognition,
+	* guarded by snapshot_mutex
+	*/
+	std::shared_ptr<const recognition_result> snapshot;
+
+	std::mutex flight_mutex;
+	/* recognitions in progress by language, optimal_productivity, fields and budget in ms */
+	std::map<std::tuple<std::string, bool, reader::field_set, long long>, std::shared_ptr<flight>> flights;
+	/* set by cancel_flights, guarded by flight_mutex */
+	bool flights_stopped = false;
+	/* continuations of handle_population that did not finish yet, guarded by flight_mutex */
+	unsigned int pending_replies = 0;
+	std::condition_variable replies_finished;
+
+	std::mutex progress_mutex;
+	/*
+	* Building counts of the last recognition with deadline by language, optimal_productivity, fields
+	* and budget in ms (like flights, so that no two running recognitions share an entry),
+	* continued by the next one with the same parameters
+	*/
+	std::map<std::tuple<std::string, bool, reader::field_set, long long>, reader::building_progress> buildings_read;
+
+	std::mutex subscribers_mutex;
+	std::condition_variable subscribers_changed;
+	std::list<std::shared_ptr<subscriber>> subscribers;
+	/* callbacks of requests waiting for a flight by due time, guarded by subscribers_mutex */
+	std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timeouts;
+	/* also wakes watch_thread and timeout_thread on shutdown */
+	bool shutting_down = false;
+	std::thread capture_thread;
+	std::thread watch_thread;
+	std::thread timeout_thread;
+};
@@ -5,6 +5,7 @@
 #include <WinSock2.h>
 #pragma comment(lib, "WS2_32.lib")
 
+#include <algorithm>
 #include <string>
 
 #include <iostream>
@@ -25,6 +26,8 @@
 #endif
 
 #include "server.hpp"
+#include "reader_assets.hpp"
+#include "reader_trace.hpp"
 
 using namespace web;
 using namespace http;
@@ -33,18 +36,21 @@ using namespace experimental::listener;
 
 std::unique_ptr<server> g_http;
 
-void on_initialize(bool verbose, std::wstring window_regex, const string_t& address)
+void on_initialize(bool verbose, std::wstring window_regex, const string_t& address, std::chrono::milliseconds ocr_timeout)
 {
-	// Build our listener's URI from the configured address and the hard-coded path "MyServer/Action"
+	// Build our listener's URI from the configured address and the hard-coded path "AnnoServer"
+	// routes: AnnoServer/Population (single result), AnnoServer/Stream (server-sent events),
+	// AnnoServer/metrics (Prometheus), AnnoServer/trace (Chrome trace events, requires -t)
 
 	uri_builder uri(address);
-	uri.append_path(U("AnnoServer/Population"));
+	uri.append_path(U("AnnoServer"));
 
 	auto addr = uri.to_uri().to_string();
-	g_http = std::make_unique<server>(verbose, window_regex, addr);
+	g_http = std::make_unique<server>(verbose, window_regex, addr, ocr_timeout);
 	g_http->open().wait();
 
-	ucout << utility::string_t(U("Listening for requests at: ")) << addr << std::endl;
+	ucout << utility::string_t(U("Listening for requests at: ")) << addr << U("/Population") << std::endl;
+	ucout << utility::string_t(U("Streaming changes at: ")) << addr << U("/Stream") << std::endl;
 }
 
 void on_shutdown()
@@ -56,7 +62,9 @@ int wmain(int argc, wchar_t* argv[])
 {
 	string_t port = U("8000");
 	bool verbose = false;
+	bool build_assets = false;
 	std::wstring window_regex;
+	std::chrono::milliseconds ocr_timeout = reader::image_recognition::default_ocr_timeout;
 
 	int i = 1;
 	while (i < argc)
@@ -66,10 +74,26 @@ int wmain(int argc, wchar_t* argv[])
 			verbose = true;
 			i++;
 		}
+		else if (std::wcscmp(argv[i], U("-t")) == 0)
+		{
+			reader::trace::get().enabled = true;
+			i++;
+		}
+		else if (std::wcscmp(argv[i], U("-b")) == 0)
+		{
+			build_assets = true;
+			i++;
+		}
 		else if (std::wcscmp(argv[i], U("-w")) == 0)
 		{
 			window_regex = argv[i + 1];
 			i += 2;
+		}
+		else if (std::wcscmp(argv[i], U("-c")) == 0 && i + 1 < argc)
+		{
+			// maximal duration of a tesseract call in ms
+			ocr_timeout = std::chrono::milliseconds(std::max(1L, std::wcstol(argv[i + 1], nullptr, 10)));
+			i += 2;
 		} else if(std::wcscmp(argv[i], U("-p")) == 0)
 		{
 			port = argv[i + 1];
@@ -78,11 +102,26 @@ int wmain(int argc, wchar_t* argv[])
 			i++;
 	}
 
+	if (build_assets)
+	{
+		// compile texts and icons into a bundle that is loaded on the next start
+		try {
+			reader::assets::load_json(verbose)->write_bundle(reader::assets::bundle_path);
+			std::cout << "Written " << reader::assets::bundle_path << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	utility::string_t address = U("http://localhost:");
 	address.append(port);
 
 	try {
-		on_initialize(verbose, window_regex, address);
+		on_initialize(verbose, window_regex, address, ocr_timeout);
 		std::cout << "Press ENTER to exit." << std::endl;
 
 		std::string line;
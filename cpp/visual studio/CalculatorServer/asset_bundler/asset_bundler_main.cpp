@@ -0,0 +1,63 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "reader_assets.hpp"
+
+using namespace reader;
+
+/*
+* Compiles texts/params.json, texts/ui_texts.json and the icon atlases into a bundle, like Server.exe -b,
+* but without starting a server so that it can run as a build step.
+* Has to be started in the assets directory (texts/, icons/).
+*
+* The bundle is read back afterwards. The exit code is 1 if it cannot be written or if its
+* source stamps do not match the files, e.g. because they were modified while bundling.
+*
+* Usage: asset_bundler [-v] [-o output]
+*/
+
+int main(int argc, char** argv)
+{
+	std::string output = assets::bundle_path;
+	bool verbose = false;
+
+	int i = 1;
+	while (i < argc)
+	{
+		if (std::strcmp(argv[i], "-v") == 0)
+		{
+			verbose = true;
+			i++;
+		}
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			output = argv[i + 1];
+			i += 2;
+		}
+		else
+		{
+			std::cout << "Usage: asset_bundler [-v] [-o output]" << std::endl;
+			return 1;
+		}
+	}
+
+	try {
+		assets::load_json(verbose)->write_bundle(output);
+
+		if (!assets::load_bundle(output))
+		{
+			std::cout << output << " does not match its sources" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cout << "Written " << output << std::endl;
+	return 0;
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "../Server/response_builder.hpp"
+#include "reader_assets.hpp"
+#include "reader_statistics.hpp"
+#include "version.hpp"
+
+using namespace reader;
+
+/*
+* Runs the reader over archived screenshots and writes one JSON line per frame
+*
+* The images are decoded by a prefetching thread and recognized on a pool of workers,
+* each with its own image_recognition (OCR engine) sharing the game data.
+* Every line has the schema of AnnoServer/Population with the additional key "file",
+* frames that fail contain "file" and "error" instead. Lines are written in input order.
+* Has to be started in the assets directory (texts/, icons/, tessdata/).
+*
+* Inputs are image files, directories (all images in it) and @list.txt (one path per line).
+*
+* Usage: batch [-l language] [-j threads] [-p prefetched frames] [-o output.jsonl] <inputs>...
+*/
+
+namespace
+{
+
+struct frame
+{
+	size_t index;
+	std::filesystem::path file;
+	cv::Mat image;
+	std::string error;
+};
+
+/*
+* Blocks producers while it holds @param{capacity} elements and
+* consumers while it is empty and not closed
+*/
+template<typename T>
+class bounded_queue
+{
+public:
+	explicit bounded_queue(size_t capacity)
+		:
+		capacity(std::max<size_t>(capacity, 1))
+	{}
+
+	void push(T value)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return elements.size() < capacity; });
+		elements.push_back(std::move(value));
+		not_empty.notify_one();
+	}
+
+	/*
+	* Returns false if the queue is closed and empty
+	*/
+	bool pop(T& value)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]() { return closed || !elements.empty(); });
+		if (elements.empty())
+			return false;
+
+		value = std::move(elements.front());
+		elements.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+
+private:
+	const size_t capacity;
+	std::deque<T> elements;
+	bool closed = false;
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+};
+
+bool is_image(const std::filesystem::path& file)
+{
+	std::string extension = file.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp";
+}
+
+void collect(const std::string& input, std::vector<std::filesystem::path>& files)
+{
+	if (!input.empty() && input.front() == '@')
+	{
+		std::ifstream list(input.substr(1));
+		if (!list)
+			throw std::invalid_argument("failed to open " + input.substr(1));
+
+		std::string line;
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (!line.empty())
+				files.emplace_back(line);
+		}
+	}
+	else if (std::filesystem::is_directory(input))
+	{
+		std::vector<std::filesystem::path> images;
+		for (const auto& entry : std::filesystem::directory_iterator(input))
+			if (entry.is_regular_file() && is_image(entry.path()))
+				images.push_back(entry.path());
+
+		std::sort(images.begin(), images.end());
+		files.insert(files.end(), images.begin(), images.end());
+	}
+	else
+		files.emplace_back(input);
+}
+
+std::string escape(const std::string& str)
+{
+	std::string result;
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			result.push_back('\\');
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char code[8];
+			std::snprintf(code, sizeof(code), "\\u%04x", c);
+			result += code;
+			continue;
+		}
+		result.push_back(c);
+	}
+	return result;
+}
+
+/*
+* Recognizes frames from @param{input} until it is closed
+*/
+void work(const std::shared_ptr<const assets>& model,
+	const std::string& language,
+	bounded_queue<frame>& input,
+	const std::function<void(size_t, std::string, bool)>& emit)
+{
+	image_recognition recog(model, false);
+	statistics stats(recog);
+	response_builder builder;
+
+	frame f;
+	while (input.pop(f))
+	{
+		const std::string file = "{\"file\":\"" + escape(f.file.string()) + "\"";
+
+		if (!f.error.empty())
+		{
+			emit(f.index, file + ",\"error\":\"" + escape(f.error) + "\"}", true);
+			continue;
+		}
+
+		try {
+			stats.update(language, f.image);
+			const std::string island = stats.get_selected_island();
+
+			guid_values population, buildings, productivities;
+			if (!island.empty())
+			{
+				population = stats.get_population_amount();
+				buildings = stats.get_assets_existing_buildings();
+				productivities = stats.get_average_productivities();
+			}
+
+			const std::string& body = builder.build(response_builder::format::JSON,
+				version::VERSION_TAG, island, population, buildings, productivities);
+
+			// the document always starts with "{" followed by the version
+			emit(f.index, file + "," + body.substr(1), false);
+		}
+		catch (const std::exception& e)
+		{
+			emit(f.index, file + ",\"error\":\"" + escape(e.what()) + "\"}", true);
+		}
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string language = "english";
+	std::string output;
+	unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned int prefetch = 0;
+	std::vector<std::string> inputs;
+
+	int i = 1;
+	while (i < argc)
+	{
+		if (std::strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+		{
+			language = argv[i + 1];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			threads = std::max(1, std::atoi(argv[i + 1]));
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+		{
+			prefetch = std::max(1, std::atoi(argv[i + 1]));
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			output = argv[i + 1];
+			i += 2;
+		}
+		else
+		{
+			inputs.push_back(argv[i]);
+			i++;
+		}
+	}
+
+	if (inputs.empty())
+	{
+		std::cerr << "Usage: batch [-l language] [-j threads] [-p prefetched frames] [-o output.jsonl] <image | directory | @list.txt>..." << std::endl;
+		return 1;
+	}
+
+	std::vector<std::filesystem::path> files;
+	std::shared_ptr<const assets> model;
+	try {
+		for (const auto& input : inputs)
+			collect(input, files);
+
+		model = assets::load(false);
+		if (!model->has_language(language))
+			throw std::invalid_argument("language not found: " + language);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::ofstream file_stream;
+	if (!output.empty())
+	{
+		file_stream.open(output);
+		if (!file_stream)
+		{
+			std::cerr << "Failed to open " << output << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = output.empty() ? std::cout : file_stream;
+
+	// parallelism comes from the workers
+	cv::setNumThreads(0);
+
+	bounded_queue<frame> queue(prefetch ? prefetch : 2 * threads);
+
+	std::thread decoder([&]() {
+		for (size_t index = 0; index < files.size(); index++)
+		{
+			frame f;
+			f.index = index;
+			f.file = files[index];
+			try {
+				f.image = image_recognition::load_image(f.file.string());
+			}
+			catch (const std::exception& e)
+			{
+				f.error = e.what();
+			}
+			queue.push(std::move(f));
+		}
+		queue.close();
+	});
+
+	// records are written in input order, finished frames wait here for their predecessors
+	std::mutex finished_mutex;
+	std::condition_variable finished_changed;
+	std::map<size_t, std::pair<std::string, bool>> finished;
+
+	const std::function<void(size_t, std::string, bool)> emit = [&](size_t index, std::string record, bool failed) {
+		std::lock_guard<std::mutex> lock(finished_mutex);
+		finished.emplace(index, std::make_pair(std::move(record), failed));
+		finished_changed.notify_one();
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; t++)
+		workers.emplace_back(work, std::cref(model), std::cref(language), std::ref(queue), std::cref(emit));
+
+	size_t errors = 0;
+	for (size_t next = 0; next < files.size(); next++)
+	{
+		std::pair<std::string, bool> record;
+		{
+			std::unique_lock<std::mutex> lock(finished_mutex);
+			finished_changed.wait(lock, [&]() { return !finished.empty() && finished.begin()->first == next; });
+			record = std::move(finished.begin()->second);
+			finished.erase(finished.begin());
+		}
+
+		errors += record.second;
+		out << record.first << '\n';
+
+		if ((next + 1) % 100 == 0)
+			std::cerr << next + 1 << " / " << files.size() << std::endl;
+	}
+	out.flush();
+
+	decoder.join();
+	for (auto& worker : workers)
+		worker.join();
+
+	std::cerr << files.size() << " frames, " << errors << " errors" << std::endl;
+	return out ? 0 : 1;
+}
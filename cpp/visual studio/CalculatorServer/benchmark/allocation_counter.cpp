@@ -0,0 +1,85 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <opencv2/core/mat.hpp>
+
+namespace
+{
+
+std::atomic<unsigned long long> allocation_count(0);
+std::atomic<unsigned long long> allocated_bytes(0);
+
+/* forwards to the standard allocator of OpenCV */
+class counting_mat_allocator : public cv::MatAllocator
+{
+public:
+	counting_mat_allocator()
+		:
+		std_allocator(cv::Mat::getStdAllocator())
+	{}
+
+	cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+		cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override
+	{
+		cv::UMatData* result = std_allocator->allocate(dims, sizes, type, data, step, flags, usage_flags);
+		if (result && !data)
+		{
+			allocation_count.fetch_add(1, std::memory_order_relaxed);
+			allocated_bytes.fetch_add(result->size, std::memory_order_relaxed);
+		}
+		return result;
+	}
+
+	bool allocate(cv::UMatData* data, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override
+	{
+		return std_allocator->allocate(data, access_flags, usage_flags);
+	}
+
+	void deallocate(cv::UMatData* data) const override
+	{
+		std_allocator->deallocate(data);
+	}
+
+private:
+	cv::MatAllocator* std_allocator;
+};
+
+}
+
+void* operator new(std::size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+unsigned long long allocation_counter::allocations()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+unsigned long long allocation_counter::bytes()
+{
+	return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+void allocation_counter::count_mat_allocations()
+{
+	static counting_mat_allocator allocator;
+	cv::Mat::setDefaultAllocator(&allocator);
+}
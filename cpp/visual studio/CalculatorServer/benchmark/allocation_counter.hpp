@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+* Counts heap allocations of the whole process.
+* Linking allocation_counter.cpp into an executable replaces its global operator new.
+*/
+class allocation_counter
+{
+public:
+	/* number of calls to operator new since program start */
+	static unsigned long long allocations();
+	/* bytes requested by these calls */
+	static unsigned long long bytes();
+
+	/*
+	* Additionally counts the pixel buffers of cv::Mat, which
+	* OpenCV allocates with its own allocator instead of operator new
+	*/
+	static void count_mat_allocations();
+};
@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "allocation_counter.hpp"
+#include "reader_metrics.hpp"
+#include "reader_statistics.hpp"
+
+using namespace reader;
+
+/*
+* Offline benchmark of the recognition pipeline
+*
+* Runs statistics::update and all getters on every image of a corpus directory
+* and writes latency percentiles, allocations and throughput as JSON.
+* Has to be started in the assets directory (texts/, icons/, tessdata/).
+*
+* Images with a sidecar file (screenshot.jpg -> screenshot.json) are checked against it:
+* {
+*	"language": "german",
+*	"island": "...",
+*	"population": { "<guid>": <amount>, ... },
+*	"buildings": { "<guid>": <count>, ... },
+*	"latency_budget_ms": <maximal median end to end latency>
+* }
+* All fields are optional, empty objects expect nothing. With -b the median latency of every image
+* is additionally compared to a previous output of the benchmark and must not exceed it by more than
+* the tolerance -t. Latencies depend on the machine, so no baseline is checked in: write one with
+* -o baseline.json on the machine that runs the comparison and pass it to later runs there.
+* The exit code is 1 if any check fails or an image cannot be loaded.
+* -j sets the threads for the stages of statistics::update like in the server, 0 runs them serially.
+* -c sets the maximal duration of a tesseract call in ms, a crop that takes longer is unreadable.
+* An image whose recognition throws fails, its remaining iterations are skipped.
+*
+* Usage: benchmark [-n iterations] [-w warmup] [-l language] [-o output.json] [-b baseline.json] [-t tolerance] [-j stage threads] [-c ocr timeout] [-v] [corpus directory]
+*/
+
+namespace
+{
+
+const size_t stage_count = static_cast<size_t>(stage::COUNT);
+
+/* per frame measurements */
+struct sample
+{
+	double end_to_end_ms;
+	/* total time spent in each stage during the frame */
+	std::array<double, stage_count> stages_ms;
+	unsigned long long allocations;
+};
+
+struct image_result
+{
+	std::string file;
+	cv::Size size;
+	std::string language;
+	std::string island;
+	guid_values population;
+	guid_values buildings;
+	guid_values productivities;
+	std::vector<sample> samples;
+
+	/* checks were performed (sidecar or baseline) */
+	bool checked = false;
+	std::vector<std::string> failures;
+};
+
+/* expected results of an image, read from its sidecar file */
+struct expectation
+{
+	boost::optional<std::string> language;
+	boost::optional<std::string> island;
+	std::map<unsigned int, int> population;
+	std::map<unsigned int, int> buildings;
+	boost::optional<double> latency_budget_ms;
+};
+
+std::array<unsigned long long, stage_count> stage_sums()
+{
+	std::array<unsigned long long, stage_count> result;
+	for (size_t i = 0; i < stage_count; i++)
+		result[i] = metrics::get().get(static_cast<stage>(i)).sum_ns.load(std::memory_order_relaxed);
+	return result;
+}
+
+/* nearest rank percentile of @param{values}, which are sorted in place */
+double percentile(std::vector<double>& values, double p)
+{
+	if (values.empty())
+		return 0.;
+
+	std::sort(values.begin(), values.end());
+	size_t rank = static_cast<size_t>(std::ceil(p / 100. * values.size()));
+	return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void write_distribution(std::ostream& out, std::vector<double> values)
+{
+	double sum = 0.;
+	for (double value : values)
+		sum += value;
+
+	out << "{ \"mean\": " << (values.empty() ? 0. : sum / values.size())
+		<< ", \"p50\": " << percentile(values, 50)
+		<< ", \"p95\": " << percentile(values, 95)
+		<< ", \"p99\": " << percentile(values, 99)
+		<< ", \"max\": " << (values.empty() ? 0. : values.back()) << " }";
+}
+
+double median_ms(const image_result& result)
+{
+	std::vector<double> values;
+	for (const auto& s : result.samples)
+		values.push_back(s.end_to_end_ms);
+	return percentile(values, 50);
+}
+
+/*
+* Reads the sidecar of @param{image}, returns false if there is none
+*/
+bool load_expectation(const std::filesystem::path& image, expectation& result)
+{
+	std::filesystem::path sidecar(image);
+	sidecar.replace_extension(".json");
+	if (!std::filesystem::exists(sidecar))
+		return false;
+
+	boost::property_tree::ptree pt;
+	boost::property_tree::read_json(sidecar.string(), pt);
+
+	result.language = pt.get_optional<std::string>("language");
+	result.island = pt.get_optional<std::string>("island");
+	result.latency_budget_ms = pt.get_optional<double>("latency_budget_ms");
+
+	auto read_values = [&](const char* key, std::map<unsigned int, int>& values) {
+		if (!pt.get_child_optional(key))
+			return;
+		for (const auto& entry : pt.get_child(key))
+			values.emplace(static_cast<unsigned int>(std::stoul(entry.first)), entry.second.get_value<int>());
+	};
+	read_values("population", result.population);
+	read_values("buildings", result.buildings);
+
+	return true;
+}
+
+void verify(const expectation& expected, image_result& result)
+{
+	result.checked = true;
+
+	if (expected.island && *expected.island != result.island)
+		result.failures.push_back("island: expected '" + *expected.island + "', got '" + result.island + "'");
+
+	auto compare = [&](const char* name, const std::map<unsigned int, int>& expected_values, const guid_values& actual) {
+		for (const auto& entry : expected_values)
+		{
+			if (!actual.count(entry.first))
+				result.failures.push_back(std::string(name) + " " + std::to_string(entry.first) + ": expected " + std::to_string(entry.second) + ", got nothing");
+			else if (actual.at(entry.first) != entry.second)
+				result.failures.push_back(std::string(name) + " " + std::to_string(entry.first) + ": expected " + std::to_string(entry.second) + ", got " + std::to_string(actual.at(entry.first)));
+		}
+	};
+	compare("population", expected.population, result.population);
+	compare("buildings", expected.buildings, result.buildings);
+
+	const double median = median_ms(result);
+	if (expected.latency_budget_ms && median > *expected.latency_budget_ms)
+		result.failures.push_back("latency: median " + std::to_string(median) + " ms exceeds budget of " + std::to_string(*expected.latency_budget_ms) + " ms");
+}
+
+/*
+* Compares the median latencies with those of a previous run
+*/
+void compare_to_baseline(const std::string& path, double tolerance, std::vector<image_result>& results)
+{
+	boost::property_tree::ptree pt;
+	boost::property_tree::read_json(path, pt);
+
+	std::map<std::string, double> baseline;
+	for (const auto& image : pt.get_child("images"))
+		baseline.emplace(image.second.get<std::string>("file"), image.second.get<double>("end_to_end_ms.p50"));
+
+	for (auto& result : results)
+	{
+		auto iter = baseline.find(result.file);
+		if (iter == baseline.end())
+			continue;
+
+		result.checked = true;
+		const double median = median_ms(result);
+		if (median > iter->second * (1. + tolerance))
+			result.failures.push_back("latency: median " + std::to_string(median) + " ms exceeds baseline of " + std::to_string(iter->second) + " ms by more than " + std::to_string(static_cast<int>(tolerance * 100)) + "%");
+	}
+}
+
+std::string escape(const std::string& value)
+{
+	std::string result;
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+			result.push_back('\\');
+		if (static_cast<unsigned char>(c) >= 0x20)
+			result.push_back(c);
+	}
+	return result;
+}
+
+void write_samples(std::ostream& out, const std::vector<const sample*>& samples, const std::string& indent)
+{
+	std::vector<double> end_to_end;
+	std::vector<double> allocs;
+	for (const sample* s : samples)
+	{
+		end_to_end.push_back(s->end_to_end_ms);
+		allocs.push_back(static_cast<double>(s->allocations));
+	}
+
+	out << indent << "\"frames\": " << samples.size() << "," << std::endl;
+	out << indent << "\"end_to_end_ms\": ";
+	write_distribution(out, end_to_end);
+	out << "," << std::endl;
+	out << indent << "\"allocations_per_frame\": ";
+	write_distribution(out, allocs);
+	out << "," << std::endl;
+
+	out << indent << "\"stages_ms\": {" << std::endl;
+	bool first = true;
+	for (size_t i = 0; i < stage_count; i++)
+	{
+		// the benchmark runs no complete capture cycle, end_to_end_ms replaces it
+		if (static_cast<stage>(i) == stage::RECOGNITION)
+			continue;
+
+		std::vector<double> values;
+		for (const sample* s : samples)
+			values.push_back(s->stages_ms[i]);
+
+		out << (first ? "" : ",\n") << indent << "\t\"" << metrics::name(static_cast<stage>(i)) << "\": ";
+		write_distribution(out, values);
+		first = false;
+	}
+	out << std::endl << indent << "}";
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string corpus = "test_screenshots";
+	std::string language = "english";
+	std::string output = "benchmark.json";
+	std::string baseline;
+	double tolerance = 0.2;
+	unsigned int iterations = 10;
+	unsigned int warmup = 1;
+	unsigned int stage_threads = 3;
+	std::chrono::milliseconds ocr_timeout = image_recognition::default_ocr_timeout;
+	bool verbose = false;
+
+	int i = 1;
+	while (i < argc)
+	{
+		if (std::strcmp(argv[i], "-v") == 0)
+		{
+			verbose = true;
+			i++;
+		}
+		else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+		{
+			iterations = std::max(1, std::atoi(argv[i + 1]));
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			stage_threads = std::max(0, std::atoi(argv[i + 1]));
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+		{
+			warmup = std::max(0, std::atoi(argv[i + 1]));
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+		{
+			language = argv[i + 1];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			output = argv[i + 1];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+		{
+			baseline = argv[i + 1];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+		{
+			tolerance = std::atof(argv[i + 1]);
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+		{
+			ocr_timeout = std::chrono::milliseconds(std::max(1, std::atoi(argv[i + 1])));
+			i += 2;
+		}
+		else
+		{
+			corpus = argv[i];
+			i++;
+		}
+	}
+
+	std::vector<std::filesystem::path> files;
+	try {
+		for (const auto& entry : std::filesystem::directory_iterator(corpus))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+			if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp"))
+				files.push_back(entry.path());
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+	std::sort(files.begin(), files.end());
+
+	if (files.empty())
+	{
+		std::cout << "No images found in " << corpus << std::endl;
+		return 1;
+	}
+
+	allocation_counter::count_mat_allocations();
+
+	const auto load_start = std::chrono::steady_clock::now();
+	image_recognition recog(verbose);
+	recog.set_ocr_timeout(ocr_timeout);
+	statistics stats(recog, stage_threads ? std::make_shared<thread_pool>(stage_threads) : nullptr);
+	const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+
+	std::vector<image_result> results;
+	std::chrono::steady_clock::duration measured(0);
+
+	for (const auto& file : files)
+	{
+		image_result result;
+		result.file = file.filename().string();
+
+		cv::Mat image;
+		expectation expected;
+		bool has_expectation = false;
+		try {
+			image = image_recognition::load_image(file.string());
+			has_expectation = load_expectation(file, expected);
+		}
+		catch (const std::exception& e)
+		{
+			result.checked = true;
+			result.failures.push_back(std::string("load: ") + e.what());
+			std::cout << result.file << ": " << e.what() << std::endl;
+			results.push_back(std::move(result));
+			continue;
+		}
+		result.size = image.size();
+		result.language = expected.language ? *expected.language : language;
+
+		auto run = [&]() {
+			stats.update(result.language, image);
+			result.island = stats.get_selected_island();
+			result.population = stats.get_population_amount();
+			result.buildings = stats.get_assets_existing_buildings();
+			result.productivities = stats.get_average_productivities();
+		};
+
+		try {
+			for (unsigned int w = 0; w < warmup; w++)
+				run();
+
+			for (unsigned int n = 0; n < iterations; n++)
+			{
+				const auto stages_before = stage_sums();
+				const unsigned long long allocations_before = allocation_counter::allocations();
+				const auto start = std::chrono::steady_clock::now();
+
+				run();
+
+				const auto duration = std::chrono::steady_clock::now() - start;
+				const unsigned long long allocations_after = allocation_counter::allocations();
+				const auto stages_after = stage_sums();
+				measured += duration;
+
+				sample s;
+				s.end_to_end_ms = std::chrono::duration<double, std::milli>(duration).count();
+				s.allocations = allocations_after - allocations_before;
+				for (size_t st = 0; st < stage_count; st++)
+					s.stages_ms[st] = (stages_after[st] - stages_before[st]) * 1e-6;
+				result.samples.push_back(s);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			result.checked = true;
+			result.failures.push_back(std::string("recognition: ") + e.what());
+			std::cout << result.file << ": " << e.what() << std::endl;
+			results.push_back(std::move(result));
+			continue;
+		}
+
+		if (has_expectation)
+			verify(expected, result);
+
+		std::cout << result.file << " (" << result.size.width << "x" << result.size.height << "): " << std::fixed << std::setprecision(2)
+			<< std::accumulate(result.samples.begin(), result.samples.end(), 0., [](double sum, const sample& s) { return sum + s.end_to_end_ms; }) / result.samples.size()
+			<< " ms (island '" << result.island << "')" << std::endl;
+
+		results.push_back(std::move(result));
+	}
+
+	if (!baseline.empty())
+	{
+		try {
+			compare_to_baseline(baseline, tolerance, results);
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Failed to read baseline " << baseline << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	size_t failed = 0;
+	for (const auto& result : results)
+	{
+		for (const auto& failure : result.failures)
+			std::cout << "FAILED " << result.file << ": " << failure << std::endl;
+		failed += !result.failures.empty();
+	}
+
+	std::vector<const sample*> all_samples;
+	for (const auto& result : results)
+		for (const auto& s : result.samples)
+			all_samples.push_back(&s);
+
+	const double measured_s = std::chrono::duration<double>(measured).count();
+
+	std::ofstream out(output);
+	out << std::setprecision(6);
+	out << "{" << std::endl;
+	out << "\t\"corpus\": \"" << escape(corpus) << "\"," << std::endl;
+	out << "\t\"language\": \"" << escape(language) << "\"," << std::endl;
+	out << "\t\"iterations\": " << iterations << "," << std::endl;
+	out << "\t\"warmup\": " << warmup << "," << std::endl;
+	out << "\t\"load_ms\": " << load_ms << "," << std::endl;
+	out << "\t\"tolerance\": " << tolerance << "," << std::endl;
+	out << "\t\"stage_threads\": " << stage_threads << "," << std::endl;
+	out << "\t\"passed\": " << (failed ? "false" : "true") << "," << std::endl;
+	out << "\t\"throughput_fps\": " << (measured_s > 0. ? all_samples.size() / measured_s : 0.) << "," << std::endl;
+	write_samples(out, all_samples, "\t");
+	out << "," << std::endl;
+
+	out << "\t\"images\": [" << std::endl;
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const auto& result = results[r];
+		std::vector<const sample*> samples;
+		for (const auto& s : result.samples)
+			samples.push_back(&s);
+
+		out << "\t\t{" << std::endl;
+		out << "\t\t\t\"file\": \"" << escape(result.file) << "\"," << std::endl;
+		out << "\t\t\t\"width\": " << result.size.width << "," << std::endl;
+		out << "\t\t\t\"height\": " << result.size.height << "," << std::endl;
+		out << "\t\t\t\"language\": \"" << escape(result.language) << "\"," << std::endl;
+		out << "\t\t\t\"island\": \"" << escape(result.island) << "\"," << std::endl;
+		out << "\t\t\t\"population_entries\": " << result.population.size() << "," << std::endl;
+		out << "\t\t\t\"building_entries\": " << result.buildings.size() << "," << std::endl;
+		out << "\t\t\t\"productivity_entries\": " << result.productivities.size() << "," << std::endl;
+		if (result.checked)
+		{
+			out << "\t\t\t\"passed\": " << (result.failures.empty() ? "true" : "false") << "," << std::endl;
+			out << "\t\t\t\"failures\": [";
+			for (size_t f = 0; f < result.failures.size(); f++)
+				out << (f ? ", " : "") << "\"" << escape(result.failures[f]) << "\"";
+			out << "]," << std::endl;
+		}
+		write_samples(out, samples, "\t\t\t");
+		out << std::endl << "\t\t}" << (r + 1 < results.size() ? "," : "") << std::endl;
+	}
+	out << "\t]" << std::endl;
+	out << "}" << std::endl;
+
+	if (!out)
+	{
+		std::cout << "Failed to write " << output << std::endl;
+		return 1;
+	}
+
+	std::cout << "Written " << output << std::endl;
+	if (failed)
+	{
+		std::cout << failed << " of " << results.size() << " images failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "reader_util.hpp"
+
+using namespace reader;
+
+/*
+* Generates a multi-resolution corpus from a directory of 16:9 screenshots
+*
+* Every image is written in each variant as <name>_<variant>.<ext>, its sidecar file
+* (see benchmark) is carried over with the additional fields "source", "variant",
+* "width" and "height". A latency budget is scaled with the pixel count if the variant is larger.
+*
+* Variants:
+*	720p, 1080p, 1440p, 2160p	rescaled 16:9
+*	21x9, 32x9			1080 rows, the HUD is anchored at the left and right border
+*					and windows stay centered like in game
+*	21x9_letterbox, 32x9_letterbox	1080 rows, 16:9 image centered between black bars
+*
+* Usage: corpus_generator [-s variant,...] [-q jpeg_quality] <input directory> <output directory>
+*/
+
+namespace
+{
+
+enum class layout
+{
+	SCALED,
+	ANCHORED,
+	LETTERBOX
+};
+
+struct variant
+{
+	const char* name;
+	cv::Size size;
+	layout mode;
+};
+
+const variant variants[] = {
+	{ "720p", cv::Size(1280, 720), layout::SCALED },
+	{ "1080p", cv::Size(1920, 1080), layout::SCALED },
+	{ "1440p", cv::Size(2560, 1440), layout::SCALED },
+	{ "2160p", cv::Size(3840, 2160), layout::SCALED },
+	{ "21x9", cv::Size(2520, 1080), layout::ANCHORED },
+	{ "32x9", cv::Size(3840, 1080), layout::ANCHORED },
+	{ "21x9_letterbox", cv::Size(2520, 1080), layout::LETTERBOX },
+	{ "32x9_letterbox", cv::Size(3840, 1080), layout::LETTERBOX }
+};
+
+enum class anchoring
+{
+	LEFT,
+	CENTER,
+	RIGHT
+};
+
+/*
+* UI elements of the game and the border the game attaches them to on wider screens.
+* Measured in the 2560x1440 screenshots of assets/test_screenshots, coordinates relative to the 16:9 image.
+* Deliberately independent of the reader's layout, so that a wrong assumption there fails the corpus.
+*/
+struct ui_element
+{
+	const char* name;
+	float x1;
+	float y1;
+	float x2;
+	float y2;
+	anchoring anchor;
+};
+
+const ui_element ui_elements[] = {
+	{ "resources", 0.000f, 0.000f, 0.276f, 0.048f, anchoring::LEFT },
+	{ "island name", 0.442f, 0.000f, 0.557f, 0.051f, anchoring::CENTER },
+	{ "side menu", 0.000f, 0.203f, 0.029f, 0.643f, anchoring::LEFT },
+	{ "minimap and population", 0.000f, 0.700f, 0.191f, 1.000f, anchoring::LEFT },
+	{ "build menu", 0.801f, 0.927f, 1.000f, 1.000f, anchoring::RIGHT },
+	{ "statistics window", 0.228f, 0.143f, 0.767f, 0.860f, anchoring::CENTER }
+};
+
+cv::Mat resize(const cv::Mat& img, cv::Size size)
+{
+	cv::Mat result;
+	int interpolation = size.area() < img.size().area() ? cv::INTER_AREA : cv::INTER_CUBIC;
+	cv::resize(img, result, size, 0, 0, interpolation);
+	return result;
+}
+
+/*
+* Widens the 16:9 image @param{normal} (already scaled to the target height) to @param{size}.
+* The stretched image serves as background for the scene, every element of ui_elements
+* is copied unscaled to its border or kept centered, like in game.
+*/
+cv::Mat anchor(const cv::Mat& normal, cv::Size size)
+{
+	cv::Mat result = resize(normal, size);
+
+	const cv::Rect normal_bounds(0, 0, normal.cols, normal.rows);
+	for (const ui_element& element : ui_elements)
+	{
+		const cv::Rect source = cv::Rect(cv::Point(static_cast<int>(element.x1 * normal.cols), static_cast<int>(element.y1 * normal.rows)),
+			cv::Point(static_cast<int>(element.x2 * normal.cols), static_cast<int>(element.y2 * normal.rows))) & normal_bounds;
+		if (!source.area())
+			continue;
+
+		int x = source.x;
+		if (element.anchor == anchoring::CENTER)
+			x += (size.width - normal.cols) / 2;
+		else if (element.anchor == anchoring::RIGHT)
+			x += size.width - normal.cols;
+
+		normal(source).copyTo(result(cv::Rect(x, source.y, source.width, source.height)));
+	}
+
+	return result;
+}
+
+cv::Mat letterbox(const cv::Mat& normal, cv::Size size)
+{
+	cv::Mat result(size, normal.type(), cv::Scalar::all(0));
+	normal.copyTo(result(cv::Rect((size.width - normal.cols) / 2, 0, normal.cols, normal.rows)));
+	return result;
+}
+
+cv::Mat render(const cv::Mat& img, const variant& v)
+{
+	if (v.mode == layout::SCALED)
+		return resize(img, v.size);
+
+	cv::Mat normal = resize(img, cv::Size(v.size.height * 16 / 9, v.size.height));
+	if (v.mode == layout::ANCHORED)
+		return anchor(normal, v.size);
+	else
+		return letterbox(normal, v.size);
+}
+
+std::vector<const variant*> select_variants(const std::string& list)
+{
+	std::vector<const variant*> result;
+	if (list.empty())
+	{
+		for (const variant& v : variants)
+			result.push_back(&v);
+		return result;
+	}
+
+	std::stringstream stream(list);
+	std::string name;
+	while (std::getline(stream, name, ','))
+	{
+		auto iter = std::find_if(std::begin(variants), std::end(variants), [&](const variant& v) { return name == v.name; });
+		if (iter == std::end(variants))
+			throw std::invalid_argument("unknown variant " + name);
+		result.push_back(&*iter);
+	}
+
+	return result;
+}
+
+/*
+* Writes the sidecar of @param{source} for the variant @param{v} of it
+*/
+void write_sidecar(const std::filesystem::path& source, const cv::Size& source_size, const std::filesystem::path& target, const variant& v)
+{
+	std::filesystem::path sidecar(source);
+	sidecar.replace_extension(".json");
+	if (!std::filesystem::exists(sidecar))
+		return;
+
+	boost::property_tree::ptree pt;
+	boost::property_tree::read_json(sidecar.string(), pt);
+
+	pt.put("source", source.filename().string());
+	pt.put("variant", v.name);
+	pt.put("width", v.size.width);
+	pt.put("height", v.size.height);
+
+	auto budget = pt.get_optional<double>("latency_budget_ms");
+	if (budget)
+	{
+		double scale = static_cast<double>(v.size.area()) / std::max(1, source_size.area());
+		pt.put("latency_budget_ms", *budget * std::max(1., scale));
+	}
+
+	std::filesystem::path target_sidecar(target);
+	target_sidecar.replace_extension(".json");
+	boost::property_tree::write_json(target_sidecar.string(), pt);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string variant_list;
+	int quality = 95;
+	std::vector<std::string> directories;
+
+	int i = 1;
+	while (i < argc)
+	{
+		if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+		{
+			variant_list = argv[i + 1];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "-q") == 0 && i + 1 < argc)
+		{
+			quality = std::min(100, std::max(1, std::atoi(argv[i + 1])));
+			i += 2;
+		}
+		else
+		{
+			directories.push_back(argv[i]);
+			i++;
+		}
+	}
+
+	if (directories.size() != 2)
+	{
+		std::cout << "Usage: corpus_generator [-s variant,...] [-q jpeg_quality] <input directory> <output directory>" << std::endl;
+		return 1;
+	}
+
+	const std::filesystem::path input(directories[0]);
+	const std::filesystem::path output(directories[1]);
+
+	try {
+		const std::vector<const variant*> selected = select_variants(variant_list);
+		std::filesystem::create_directories(output);
+
+		std::vector<std::filesystem::path> files;
+		for (const auto& entry : std::filesystem::directory_iterator(input))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+			if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp"))
+				files.push_back(entry.path());
+		}
+		std::sort(files.begin(), files.end());
+
+		const std::vector<int> jpeg_params = { cv::IMWRITE_JPEG_QUALITY, quality };
+		size_t written = 0;
+
+		for (const auto& file : files)
+		{
+			cv::Mat img = cv::imread(file.string(), cv::IMREAD_COLOR);
+			if (img.empty())
+			{
+				std::cout << "Failed to load " << file.string() << std::endl;
+				continue;
+			}
+
+			// the variants are derived from the 16:9 part of the source
+			img = image_recognition::crop_widescreen(img);
+
+			for (const variant* v : selected)
+			{
+				std::filesystem::path target = output / (file.stem().string() + "_" + v->name + file.extension().string());
+				if (!cv::imwrite(target.string(), render(img, *v), jpeg_params))
+					throw std::runtime_error("failed to write " + target.string());
+
+				write_sidecar(file, img.size(), target, *v);
+				written++;
+			}
+
+			std::cout << file.filename().string() << std::endl;
+		}
+
+		std::cout << "Written " << written << " images to " << output.string() << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../benchmark/allocation_counter.hpp"
+#include "reader_layout.hpp"
+#include "reader_metrics.hpp"
+#include "reader_statistics_screen.hpp"
+#include "reader_util.hpp"
+
+using namespace reader;
+
+/*
+* Microbenchmarks of the image_recognition primitives, without OCR
+*
+* Every case runs in a calibrated loop of at least the minimal time per repetition,
+* the median over all repetitions is reported as ns/op, allocations/op and bytes/op
+* (operator new and cv::Mat buffers). The thread is pinned to one CPU and
+* OpenCV runs single threaded.
+* Has to be started in the assets directory (texts/, icons/).
+*
+* Usage: microbenchmark [-f regex] [-r repetitions] [-m min_ms] [-c cpu] [-i screenshot] [-o output.json]
+*/
+
+namespace
+{
+
+struct measurement
+{
+	double ns_per_op;
+	double allocations_per_op;
+	double bytes_per_op;
+};
+
+struct result
+{
+	std::string name;
+	unsigned long long iterations;
+	measurement median;
+	double min_ns_per_op;
+	double max_ns_per_op;
+};
+
+/* prevents that the compiler removes the benchmarked calls */
+volatile size_t sink;
+
+void consume(size_t value)
+{
+	sink = sink + value;
+}
+
+void pin_thread(int cpu)
+{
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		std::cout << "Failed to pin thread to CPU " << cpu << std::endl;
+#endif
+}
+
+class runner
+{
+public:
+	runner(unsigned int repetitions, std::chrono::milliseconds min_time, std::string filter)
+		:
+		repetitions(repetitions),
+		min_time(min_time),
+		filter(filter.empty() ? ".*" : filter)
+	{}
+
+	void run(const std::string& name, const std::function<void()>& op)
+	{
+		if (!std::regex_search(name, filter))
+			return;
+
+		// warmup and calibration: double the iterations until a batch takes min_time
+		unsigned long long iterations = 1;
+		while (true)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (unsigned long long i = 0; i < iterations; i++)
+				op();
+			if (std::chrono::steady_clock::now() - start >= min_time || iterations >= (1ull << 40))
+				break;
+			iterations *= 2;
+		}
+
+		std::vector<measurement> measurements;
+		for (unsigned int r = 0; r < repetitions; r++)
+		{
+			const unsigned long long allocations_before = allocation_counter::allocations();
+			const unsigned long long bytes_before = allocation_counter::bytes();
+			const auto start = std::chrono::steady_clock::now();
+
+			for (unsigned long long i = 0; i < iterations; i++)
+				op();
+
+			const auto duration = std::chrono::steady_clock::now() - start;
+			measurement m;
+			m.ns_per_op = std::chrono::duration<double, std::nano>(duration).count() / iterations;
+			m.allocations_per_op = static_cast<double>(allocation_counter::allocations() - allocations_before) / iterations;
+			m.bytes_per_op = static_cast<double>(allocation_counter::bytes() - bytes_before) / iterations;
+			measurements.push_back(m);
+		}
+
+		std::sort(measurements.begin(), measurements.end(), [](const measurement& lhs, const measurement& rhs) {
+			return lhs.ns_per_op < rhs.ns_per_op;
+			});
+
+		result r;
+		r.name = name;
+		r.iterations = iterations;
+		r.median = measurements[measurements.size() / 2];
+		r.min_ns_per_op = measurements.front().ns_per_op;
+		r.max_ns_per_op = measurements.back().ns_per_op;
+
+		std::cout << std::left << std::setw(48) << name << std::right << std::fixed
+			<< std::setprecision(0) << std::setw(14) << r.median.ns_per_op << " ns/op"
+			<< std::setprecision(1) << std::setw(10) << r.median.allocations_per_op << " allocs/op"
+			<< std::setprecision(0) << std::setw(14) << r.median.bytes_per_op << " B/op" << std::endl;
+
+		results.push_back(r);
+	}
+
+	void write_json(std::ostream& out) const
+	{
+		out << std::setprecision(6) << "{" << std::endl
+			<< "\t\"repetitions\": " << repetitions << "," << std::endl
+			<< "\t\"min_time_ms\": " << min_time.count() << "," << std::endl
+			<< "\t\"benchmarks\": [" << std::endl;
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const result& r = results[i];
+			out << "\t\t{ \"name\": \"" << r.name << "\""
+				<< ", \"iterations\": " << r.iterations
+				<< ", \"ns_per_op\": " << r.median.ns_per_op
+				<< ", \"min_ns_per_op\": " << r.min_ns_per_op
+				<< ", \"max_ns_per_op\": " << r.max_ns_per_op
+				<< ", \"allocations_per_op\": " << r.median.allocations_per_op
+				<< ", \"bytes_per_op\": " << r.median.bytes_per_op
+				<< " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+		}
+
+		out << "\t]" << std::endl << "}" << std::endl;
+	}
+
+private:
+	unsigned int repetitions;
+	std::chrono::milliseconds min_time;
+	std::regex filter;
+	std::vector<result> results;
+};
+
+/*
+* Dictionary of @param{size} icons, taken from the loaded icons and
+* padded with noise icons if there are fewer
+*/
+std::map<unsigned int, cv::Mat> make_dictionary(const std::map<unsigned int, cv::Mat>& icons, size_t size, cv::Size icon_size)
+{
+	std::map<unsigned int, cv::Mat> result;
+	for (const auto& entry : icons)
+	{
+		if (result.size() >= size)
+			break;
+		result.emplace(entry.first, entry.second);
+	}
+
+	cv::RNG rng(1404);
+	for (unsigned int guid = 1; result.size() < size; guid++)
+	{
+		cv::Mat icon(icon_size, CV_8UC4);
+		rng.fill(icon, cv::RNG::UNIFORM, 0, 256);
+		result.emplace(guid, icon);
+	}
+
+	return result;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter;
+	std::string screenshot = "test_screenshots/screenshot0082.jpg";
+	std::string output = "microbenchmark.json";
+	unsigned int repetitions = 9;
+	unsigned int min_ms = 200;
+	int cpu = 0;
+
+	int i = 1;
+	while (i + 1 < argc)
+	{
+		if (std::strcmp(argv[i], "-f") == 0)
+			filter = argv[i + 1];
+		else if (std::strcmp(argv[i], "-r") == 0)
+			repetitions = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "-m") == 0)
+			min_ms = std::max(1, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "-c") == 0)
+			cpu = std::max(0, std::atoi(argv[i + 1]));
+		else if (std::strcmp(argv[i], "-i") == 0)
+			screenshot = argv[i + 1];
+		else if (std::strcmp(argv[i], "-o") == 0)
+			output = argv[i + 1];
+		i += 2;
+	}
+
+	pin_thread(cpu);
+	cv::setNumThreads(0);
+	metrics::get().enabled = false;
+	allocation_counter::count_mat_allocations();
+
+	image_recognition recog(false);
+	cv::Mat source;
+	try {
+		source = image_recognition::load_image(screenshot);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	runner bench(repetitions, std::chrono::milliseconds(min_ms), filter);
+
+	const std::vector<std::pair<std::string, cv::Size>> resolutions = {
+		{ "720p", cv::Size(1280, 720) },
+		{ "1080p", cv::Size(1920, 1080) },
+		{ "1440p", cv::Size(2560, 1440) },
+		{ "2160p", cv::Size(3840, 2160) }
+	};
+
+	for (const auto& resolution : resolutions)
+	{
+		const std::string suffix = "/" + resolution.first;
+
+		cv::Mat frame;
+		cv::resize(source, frame, resolution.second, 0, 0, cv::INTER_LINEAR);
+
+		const auto plan = layout_plan::for_frame(frame.size());
+		const cv::Mat production = frame(plan->get(pane::STATISTICS_PRODUCTION));
+		const cv::Mat island = frame(plan->get(pane::STATISTICS_ISLAND));
+		const cv::Size icon_size = plan->get(pane::STATISTICS_FRAMED_ICON).size();
+		const cv::Mat icon = production(cv::Rect(cv::Point(0, 0), icon_size)).clone();
+
+		bench.run("get_pane" + suffix, [&]() {
+			consume(image_recognition::get_pane(relative(pane::STATISTICS_PRODUCTION), frame).total());
+			});
+
+		bench.run("layout_plan" + suffix, [&]() {
+			consume(frame(layout_plan::for_frame(frame.size())->get(pane::STATISTICS_PRODUCTION)).total());
+			});
+
+		bench.run("binarize" + suffix, [&]() {
+			consume(image_recognition::binarize(island, true).total());
+			});
+
+		bench.run("blend_icon" + suffix, [&]() {
+			consume(image_recognition::blend_icon(icon, statistics_screen_params::icon_background).total());
+			});
+
+		for (size_t dictionary_size : { 16, 128, 512 })
+		{
+			const auto dictionary = make_dictionary(recog.get_assets().building_icons, dictionary_size, icon_size);
+			bench.run("get_guid_from_icon/" + std::to_string(dictionary_size) + suffix, [&]() {
+				consume(recog.get_guid_from_icon(icon, dictionary, statistics_screen_params::icon_background).size());
+				});
+		}
+
+		bench.run("detect_boxes" + suffix, [&]() {
+			consume(image_recognition::detect_boxes(production, icon_size.width, icon_size.height, cv::Rect2i(), 0.1f).size());
+			});
+
+		bench.run("find_horizontal_lines" + suffix, [&]() {
+			consume(image_recognition::find_horizontal_lines(production).size());
+			});
+
+		bench.run("find_rgb_region" + suffix, [&]() {
+			consume(image_recognition::find_rgb_region(production, cv::Point(production.cols / 2, production.rows / 2), 100.f).size());
+			});
+
+		bench.run("match_template" + suffix, [&]() {
+			consume(image_recognition::match_template(production, icon).first.area());
+			});
+	}
+
+	const std::vector<std::pair<std::string, std::string>> word_pairs = {
+		{ "short", "Bauern" },
+		{ "medium", "Adlige Kolonie am Meer" },
+		{ "long", "Die Insel des Handelsprinzen mit dem langen Namen" }
+	};
+
+	for (const auto& words : word_pairs)
+	{
+		std::string misspelled = words.second;
+		misspelled[misspelled.size() / 2] = 'x';
+
+		bench.run("lcs_length/" + words.first, [&]() {
+			consume(image_recognition::lcs_length(words.second, misspelled));
+			});
+	}
+
+	for (const std::string& word : { std::string("981"), std::string("1.862"), std::string("l2O4") })
+	{
+		bench.run("number_from_string/" + word, [&]() {
+			consume(image_recognition::number_from_string(word));
+			});
+	}
+
+	std::ofstream out(output);
+	bench.write_json(out);
+	if (!out)
+	{
+		std::cout << "Failed to write " << output << std::endl;
+		return 1;
+	}
+
+	std::cout << "Written " << output << std::endl;
+	return 0;
+}
@@ -0,0 +1,605 @@
+#include "reader_assets.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "reader_debug_images.hpp"
+
+namespace reader
+{
+
+namespace
+{
+
+/* increment whenever the layout changes */
+const unsigned int bundle_format_version = 3;
+const char bundle_magic[4] = { 'A', '4', 'B', 'N' };
+
+/*
+* Bundle layout, all integers little endian:
+* magic, version
+* sources: count, { path, size, modification time }
+* languages: count, { name, size, 6 dictionaries of count, { guid, text } }
+* product_to_factories: count, { guid, count, { factory } }
+* guid indices (population levels, buildings): count, { guid }
+* icon tables (products, buildings, population): count, { guid, rows, cols, type, offset of pixels }
+* pixels, each icon 16 byte aligned and continuous
+*/
+
+class bundle_writer
+{
+public:
+	void u32(unsigned int value) { append(&value, sizeof(value)); }
+	void u64(unsigned long long value) { append(&value, sizeof(value)); }
+	void i64(long long value) { append(&value, sizeof(value)); }
+
+	void string(const std::string& value)
+	{
+		u32(static_cast<unsigned int>(value.size()));
+		append(value.data(), value.size());
+	}
+
+	void append(const void* data, size_t size)
+	{
+		buffer.append(static_cast<const char*>(data), size);
+	}
+
+	void align(size_t alignment)
+	{
+		buffer.append((alignment - buffer.size() % alignment) % alignment, '\0');
+	}
+
+	void patch_u64(size_t position, unsigned long long value)
+	{
+		std::memcpy(&buffer[position], &value, sizeof(value));
+	}
+
+	size_t size() const { return buffer.size(); }
+
+	std::string buffer;
+};
+
+class bundle_reader
+{
+public:
+	bundle_reader(const char* begin, size_t size)
+		: begin(begin), end(begin + size), current(begin)
+	{}
+
+	/* skips @param{size} bytes and returns their start */
+	const char* skip(size_t size)
+	{
+		check(size);
+		const char* start = current;
+		current += size;
+		return start;
+	}
+
+	bool at_end() const { return current == end; }
+
+	unsigned int u32() { unsigned int value; read(&value, sizeof(value)); return value; }
+	unsigned long long u64() { unsigned long long value; read(&value, sizeof(value)); return value; }
+	long long i64() { long long value; read(&value, sizeof(value)); return value; }
+
+	std::string string()
+	{
+		const unsigned int size = u32();
+		check(size);
+		std::string value(current, size);
+		current += size;
+		return value;
+	}
+
+	void read(void* data, size_t size)
+	{
+		check(size);
+		std::memcpy(data, current, size);
+		current += size;
+	}
+
+	const char* at(unsigned long long offset, size_t size) const
+	{
+		if (offset > static_cast<size_t>(end - begin) || size > static_cast<size_t>(end - begin) - offset)
+			throw std::runtime_error("corrupt asset bundle");
+		return begin + offset;
+	}
+
+private:
+	void check(size_t size) const
+	{
+		if (size > static_cast<size_t>(end - current))
+			throw std::runtime_error("corrupt asset bundle");
+	}
+
+	const char* begin;
+	const char* end;
+	const char* current;
+};
+
+typedef std::map<unsigned int, std::string> keyword_map;
+
+/* order in which the dictionaries of a language are stored */
+std::vector<keyword_map keyword_dictionary::*> dictionary_members()
+{
+	return {
+		&keyword_dictionary::population_levels,
+		&keyword_dictionary::buildings,
+		&keyword_dictionary::items,
+		&keyword_dictionary::products,
+		&keyword_dictionary::ui_texts,
+		&keyword_dictionary::traders
+	};
+}
+
+std::string encode(const keyword_dictionary& dictionary)
+{
+	bundle_writer out;
+	for (auto member : dictionary_members())
+	{
+		const keyword_map& map = dictionary.*member;
+		out.u32(static_cast<unsigned int>(map.size()));
+		for (const auto& entry : map)
+		{
+			out.u32(entry.first);
+			out.string(entry.second);
+		}
+	}
+	return std::move(out.buffer);
+}
+
+keyword_dictionary decode(const char* data, size_t size)
+{
+	keyword_dictionary dictionary;
+	bundle_reader in(data, size);
+	for (auto member : dictionary_members())
+	{
+		keyword_map& map = dictionary.*member;
+		const unsigned int count = in.u32();
+		for (unsigned int j = 0; j < count; j++)
+		{
+			const unsigned int guid = in.u32();
+			map.emplace_hint(map.end(), guid, in.string());
+		}
+	}
+
+	if (!in.at_end())
+		throw std::runtime_error("corrupt asset bundle");
+	return dictionary;
+}
+
+}
+
+const std::string assets::params_path = "texts/params.json";
+const std::string assets::ui_texts_path = "texts/ui_texts.json";
+const std::string assets::icons_directory = "icons/";
+const std::string assets::bundle_path = "assets.bundle";
+
+assets::source assets::source::stamp(const std::string& path)
+{
+	source result;
+	result.path = path;
+
+	std::error_code error;
+	const auto size = std::filesystem::file_size(path, error);
+	if (error)
+		return result;
+	const auto modified = std::filesystem::last_write_time(path, error);
+	if (error)
+		return result;
+
+	result.size = size;
+	result.modified = modified.time_since_epoch().count();
+	return result;
+}
+
+std::vector<assets::source> assets::stamp_sources() const
+{
+	std::vector<source> result;
+	result.reserve(sources.size());
+	for (const auto& entry : sources)
+		result.push_back(source::stamp(entry.path));
+	return result;
+}
+
+bool assets::is_outdated() const
+{
+	return stamp_sources() != sources;
+}
+
+bool assets::has_language(const std::string& language) const
+{
+	return languages.find(language) != languages.end();
+}
+
+const keyword_dictionary& assets::get_dictionary(const std::string& language) const
+{
+	auto iter = languages.find(language);
+	if (iter == languages.end())
+		throw std::invalid_argument("language not found");
+
+	language_entry& entry = iter->second;
+	std::lock_guard<std::mutex> lock(languages_mutex);
+	if (!entry.dictionary)
+	{
+		entry.dictionary = std::make_unique<const keyword_dictionary>(decode(entry.data, entry.size));
+
+		// the encoded texts are not needed anymore
+		entry.owned = std::string();
+		entry.data = nullptr;
+		entry.size = 0;
+	}
+
+	return *entry.dictionary;
+}
+
+void assets::add_language(const std::string& language, const keyword_dictionary& dictionary)
+{
+	language_entry& entry = languages[language];
+	entry.owned = encode(dictionary);
+	entry.data = entry.owned.data();
+	entry.size = entry.owned.size();
+}
+
+assets::ptr assets::load(bool verbose)
+{
+	try {
+		auto bundle = load_bundle(bundle_path);
+		if (bundle)
+		{
+			if (verbose) {
+				std::cout << "Loaded " << bundle_path << std::endl;
+			}
+			return bundle;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+
+	if (verbose && boost::filesystem::exists(bundle_path)) {
+		std::cout << bundle_path << " is outdated, load JSON files." << std::endl;
+	}
+
+	return load_json(verbose);
+}
+
+assets::ptr assets::load_json(bool verbose)
+{
+	auto result = std::make_shared<assets>();
+	// all languages are parsed at once, only encoded copies are kept
+	std::map<std::string, keyword_dictionary> dictionaries;
+
+	boost::property_tree::ptree pt;
+	result->sources.push_back(source::stamp(params_path));
+	boost::property_tree::read_json(params_path, pt);
+
+	for (const auto& language : pt.get_child("languages"))
+	{
+		std::string key(language.second.get_value<std::string>());
+		keyword_dictionary value;
+		dictionaries.emplace(key, value);
+	}
+
+	std::map<std::string, cv::Mat> icon_tables;
+	for (const auto& icon_map : pt.get_child("icons"))
+	{
+		std::string key(icon_map.second.get_value<std::string>());
+		result->sources.push_back(source::stamp(icons_directory + key));
+		icon_tables.emplace(key, image_recognition::load_image(icons_directory + key));
+	}
+
+	auto load_and_save_icon = [&](unsigned int guid,
+		const boost::property_tree::ptree& asset,
+		std::map<unsigned int, cv::Mat>& container)
+	{
+		if (asset.get_child_optional("icon").has_value())
+		{
+			try
+			{
+				auto config = asset.get_child("icon");
+				auto& icon_map = icon_tables.at(config.get_child("path").get_value<std::string>());
+				int x = config.get_child("x").get_value<int>();
+				int y = config.get_child("y").get_value<int>();
+				int width = config.get_child("width").get_value<int>();
+				int height = config.get_child("height").get_value<int>();
+				
+				cv::Mat icon = icon_map(cv::Rect2i(x,y,width,height));
+				container.emplace(guid, icon);
+
+				if (verbose) {
+					debug_image_writer::get().write("debug_images/icon_template.png", icon);
+				}
+			}
+			catch (const std::invalid_argument& e)
+			{
+				std::cout << e.what() << std::endl;
+			}
+		}
+	};
+
+	std::vector<unsigned int> population_guids;
+	std::vector<unsigned int> building_guids;
+
+	// load buildings
+	auto process_buildings = [&](const boost::property_tree::ptree& root) {
+		for (const auto& factory : root)
+		{
+			unsigned int guid = factory.second.get_child("guid").get_value<unsigned int>();
+			building_guids.push_back(guid);
+
+			load_and_save_icon(guid, factory.second, result->building_icons);
+
+			for (const auto& language : factory.second.get_child("locaText"))
+			{
+
+				dictionaries.at(language.first).buildings.emplace(guid, language.second.get_value<std::string>());
+			}
+		}
+	};
+
+	if (verbose) {
+		std::cout << "Load buildings." << std::endl;
+	}
+	process_buildings(pt.get_child("factories"));
+	process_buildings(pt.get_child("residenceBuildings"));
+	process_buildings(pt.get_child("publicBuildings"));
+
+	// load products
+	for (const auto& product : pt.get_child("products"))
+	{
+		unsigned int guid = product.second.get_child("guid").get_value<unsigned int>();
+		if (!product.second.get_child_optional("producers").has_value())
+			continue;
+
+		// store buildings and regions
+		std::vector<unsigned int> factories;
+		for (const auto& factory_entry : product.second.get_child("producers"))
+		{
+			unsigned int factory_id = factory_entry.second.get_value<unsigned int>();
+			factories.push_back(factory_id);
+			building_guids.push_back(factory_id);
+		}
+		result->product_to_factories.emplace(guid, std::move(factories));
+
+		for (const auto& language : product.second.get_child("locaText"))
+		{
+			dictionaries.at(language.first).products.emplace(guid, language.second.get_value<std::string>());
+		}
+
+		load_and_save_icon(guid, product.second, result->product_icons);
+	}
+
+	if (verbose) {
+		std::cout << "Load population levels." << std::endl;
+	}
+	// load population levels
+	for (const auto& level : pt.get_child("populationLevels"))
+	{
+		unsigned int guid = level.second.get_child("guid").get_value<unsigned int>();
+		population_guids.push_back(guid);
+		load_and_save_icon(guid, level.second, result->population_icons);
+		for (const auto& language : level.second.get_child("locaText"))
+		{
+
+			dictionaries.at(language.first).population_levels.emplace(guid, language.second.get_value<std::string>());
+		}
+	}
+
+	result->population_index = std::make_shared<const guid_index>(std::move(population_guids));
+	result->building_index = std::make_shared<const guid_index>(std::move(building_guids));
+
+	if (verbose) {
+		std::cout << "Load texts." << std::endl;
+	}
+	pt.clear();
+	if (boost::filesystem::exists(ui_texts_path))
+	{
+		result->sources.push_back(source::stamp(ui_texts_path));
+		boost::property_tree::read_json(ui_texts_path, pt);
+		for (const auto& text_node : pt)
+		{
+			std::string language = text_node.first;
+			for (const auto& entry : text_node.second)
+			{
+				unsigned int guid = std::atoi(entry.first.c_str());
+				dictionaries.at(language).ui_texts.emplace(guid, entry.second.get_value<std::string>());
+			}
+		}
+	}
+	else
+	{
+		throw std::runtime_error("ui texts not found");
+	}
+
+	for (const auto& entry : dictionaries)
+		result->add_language(entry.first, entry.second);
+
+	return result;
+}
+
+assets::ptr assets::load_bundle(const std::string& path)
+{
+	namespace bip = boost::interprocess;
+
+	if (!boost::filesystem::exists(path))
+		return nullptr;
+
+	struct mapped_file
+	{
+		bip::file_mapping file;
+		bip::mapped_region region;
+	};
+
+	// private pages: a write to an icon copies the page instead of changing the file or faulting
+	auto mapped = std::make_shared<mapped_file>();
+	mapped->file = bip::file_mapping(path.c_str(), bip::read_only);
+	mapped->region = bip::mapped_region(mapped->file, bip::copy_on_write);
+
+	char* const base = static_cast<char*>(mapped->region.get_address());
+	bundle_reader in(base, mapped->region.get_size());
+
+	char magic[sizeof(bundle_magic)];
+	in.read(magic, sizeof(magic));
+	if (std::memcmp(magic, bundle_magic, sizeof(magic)) || in.u32() != bundle_format_version)
+		return nullptr;
+
+	auto result = std::make_shared<assets>();
+
+	const unsigned int source_count = in.u32();
+	for (unsigned int i = 0; i < source_count; i++)
+	{
+		source stored;
+		stored.path = in.string();
+		stored.size = in.u64();
+		stored.modified = in.i64();
+
+		if (source::stamp(stored.path) != stored)
+			return nullptr;
+
+		result->sources.push_back(std::move(stored));
+	}
+
+	const unsigned int language_count = in.u32();
+	for (unsigned int i = 0; i < language_count; i++)
+	{
+		language_entry& entry = result->languages[in.string()];
+		entry.size = in.u64();
+		entry.data = in.skip(entry.size);
+	}
+
+	const unsigned int product_count = in.u32();
+	for (unsigned int i = 0; i < product_count; i++)
+	{
+		const unsigned int guid = in.u32();
+		std::vector<unsigned int> factories(in.u32());
+		for (auto& factory : factories)
+			factory = in.u32();
+		result->product_to_factories.emplace_hint(result->product_to_factories.end(), guid, std::move(factories));
+	}
+
+	for (auto* index : { &result->population_index, &result->building_index })
+	{
+		std::vector<unsigned int> guids(in.u32());
+		for (auto& guid : guids)
+			guid = in.u32();
+		*index = std::make_shared<const guid_index>(std::move(guids));
+	}
+
+	for (auto* icons : { &result->product_icons, &result->building_icons, &result->population_icons })
+	{
+		const unsigned int count = in.u32();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const unsigned int guid = in.u32();
+			const int rows = static_cast<int>(in.u32());
+			const int cols = static_cast<int>(in.u32());
+			const int type = static_cast<int>(in.u32());
+			const unsigned long long offset = in.u64();
+
+			const size_t size = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(type);
+			// throws if the pixels are not within the file
+			in.at(offset, size);
+			cv::Mat icon(rows, cols, type, base + offset);
+			icons->emplace_hint(icons->end(), guid, icon);
+		}
+	}
+
+	result->mapping = mapped;
+	return result;
+}
+
+void assets::write_bundle(const std::string& path) const
+{
+	bundle_writer out;
+	out.append(bundle_magic, sizeof(bundle_magic));
+	out.u32(bundle_format_version);
+
+	out.u32(static_cast<unsigned int>(sources.size()));
+	for (const auto& entry : sources)
+	{
+		out.string(entry.path);
+		out.u64(entry.size);
+		out.i64(entry.modified);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(languages_mutex);
+		out.u32(static_cast<unsigned int>(languages.size()));
+		for (const auto& language : languages)
+		{
+			out.string(language.first);
+			if (language.second.dictionary)
+			{
+				const std::string encoded = encode(*language.second.dictionary);
+				out.u64(encoded.size());
+				out.append(encoded.data(), encoded.size());
+			}
+			else
+			{
+				out.u64(language.second.size);
+				out.append(language.second.data, language.second.size);
+			}
+		}
+	}
+
+	out.u32(static_cast<unsigned int>(product_to_factories.size()));
+	for (const auto& entry : product_to_factories)
+	{
+		out.u32(entry.first);
+		out.u32(static_cast<unsigned int>(entry.second.size()));
+		for (unsigned int factory : entry.second)
+			out.u32(factory);
+	}
+
+	for (const auto* index : { &population_index, &building_index })
+	{
+		const auto& guids = (*index)->get_guids();
+		out.u32(static_cast<unsigned int>(guids.size()));
+		for (unsigned int guid : guids)
+			out.u32(guid);
+	}
+
+	// the icon tables are followed by the pixels, offsets are patched while writing them
+	std::vector<std::pair<size_t, cv::Mat>> pixels;
+	for (const auto* icons : { &product_icons, &building_icons, &population_icons })
+	{
+		out.u32(static_cast<unsigned int>(icons->size()));
+		for (const auto& entry : *icons)
+		{
+			out.u32(entry.first);
+			out.u32(static_cast<unsigned int>(entry.second.rows));
+			out.u32(static_cast<unsigned int>(entry.second.cols));
+			out.u32(static_cast<unsigned int>(entry.second.type()));
+			pixels.emplace_back(out.size(), entry.second);
+			out.u64(0);
+		}
+	}
+
+	for (const auto& entry : pixels)
+	{
+		out.align(16);
+		out.patch_u64(entry.first, out.size());
+
+		// icons are views into the atlas, copy row by row
+		const cv::Mat& icon = entry.second;
+		for (int row = 0; row < icon.rows; row++)
+			out.append(icon.ptr(row), icon.cols * icon.elemSize());
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(out.buffer.data(), out.buffer.size());
+	if (!file)
+		throw std::runtime_error("failed to write " + path);
+}
+
+}
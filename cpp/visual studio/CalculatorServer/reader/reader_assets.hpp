@@ -0,0 +1,133 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "reader_guid_index.hpp"
+#include "reader_util.hpp"
+
+namespace reader
+{
+
+/*
+* Game data loaded from texts/params.json, texts/ui_texts.json and the icon atlases in icons/
+* Immutable after loading and shared by all recognitions.
+*
+* The data can be compiled into a single binary bundle (see write_bundle).
+* Icon pixels of a bundle are used in place from the memory mapped file, which is mapped copy on write.
+*/
+class assets
+{
+public:
+	typedef std::shared_ptr<const assets> ptr;
+
+	/* file the data was loaded from, identified by size and modification time */
+	struct source
+	{
+		std::string path;
+		unsigned long long size = 0;
+		long long modified = 0;
+
+		bool operator==(const source& other) const
+		{
+			return path == other.path && size == other.size && modified == other.modified;
+		}
+
+		bool operator!=(const source& other) const { return !(*this == other); }
+
+		/* reads size and modification time of @param{path}, both are 0 if the file does not exist */
+		static source stamp(const std::string& path);
+	};
+
+	static const std::string params_path;
+	static const std::string ui_texts_path;
+	static const std::string icons_directory;
+	static const std::string bundle_path;
+
+	/*
+	* Loads the bundle if it is up to date, otherwise the JSON sources
+	*/
+	static ptr load(bool verbose);
+
+	/*
+	* Parses the JSON sources and decodes the icon atlases
+	*/
+	static ptr load_json(bool verbose);
+
+	/*
+	* Maps the bundle at @param{path}
+	* Returns nullptr if it is missing, corrupt or older than its sources
+	*/
+	static ptr load_bundle(const std::string& path);
+
+	/*
+	* Writes the bundle to @param{path}, stamped with size and modification time of all sources
+	*/
+	void write_bundle(const std::string& path) const;
+
+	/*
+	* Returns the current state of the files listed in sources
+	*/
+	std::vector<source> stamp_sources() const;
+
+	/*
+	* Returns true if any of the sources was modified or removed since loading
+	*/
+	bool is_outdated() const;
+
+	/*
+	* Returns true if texts for @param{language} are available, without loading them
+	*/
+	bool has_language(const std::string& language) const;
+
+	/*
+	* Returns the texts of @param{language}
+	* They are decoded on first use, languages that are never used stay encoded
+	* Throws std::invalid_argument if the language is not available
+	*/
+	const keyword_dictionary& get_dictionary(const std::string& language) const;
+
+	std::map<unsigned int, cv::Mat> product_icons;
+	std::map<unsigned int, cv::Mat> building_icons;
+	std::map<unsigned int, cv::Mat> population_icons;
+
+	std::map<unsigned int, std::vector<unsigned int>> product_to_factories;
+	std::map<unsigned int, std::set<unsigned int>> trader_to_offerings;
+
+	/* dense indices for recognition results (see guid_values) */
+	std::shared_ptr<const guid_index> population_index;
+	std::shared_ptr<const guid_index> building_index;
+	std::map<unsigned int, item::ptr> items;
+	std::map<unsigned int, cv::Mat> item_backgrounds;
+
+	/* files the data was loaded from, paths relative to the working directory */
+	std::vector<source> sources;
+
+private:
+	struct language_entry
+	{
+		/* encoded dictionaries, owned by the entry or pointing into the mapped bundle */
+		std::string owned;
+		const char* data = nullptr;
+		size_t size = 0;
+
+		std::unique_ptr<const keyword_dictionary> dictionary;
+	};
+
+	void add_language(const std::string& language, const keyword_dictionary& dictionary);
+
+	/* the set of languages is fixed after loading, entries are decoded under languages_mutex */
+	mutable std::map<std::string, language_entry> languages;
+	mutable std::mutex languages_mutex;
+
+	/* keeps the memory of a mapped bundle alive */
+	std::shared_ptr<void> mapping;
+};
+
+}
@@ -0,0 +1,135 @@
+#include "reader_debug_images.hpp"
+
+#include <filesystem>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "reader_metrics.hpp"
+
+namespace reader
+{
+
+debug_image_writer::debug_image_writer()
+	:
+	enabled(false),
+	png_compression(1)
+{
+}
+
+debug_image_writer& debug_image_writer::get()
+{
+	static debug_image_writer instance;
+	return instance;
+}
+
+debug_image_writer::~debug_image_writer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+	}
+	queue_changed.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+}
+
+void debug_image_writer::write(const std::string& path, const cv::Mat& img)
+{
+	if (!enabled.load(std::memory_order_relaxed) || img.empty())
+		return;
+
+	cv::Mat copy = img.clone();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopped)
+			return;
+
+		if (images >= capacity)
+		{
+			for (auto iter = queue.begin(); iter != queue.end(); ++iter)
+			{
+				if (!iter->job)
+				{
+					queue.erase(iter);
+					images--;
+					break;
+				}
+			}
+			metrics::get().increment(counter::DEBUG_IMAGES_DROPPED);
+		}
+		enqueue({ path, std::move(copy), nullptr });
+		images++;
+	}
+	queue_changed.notify_all();
+}
+
+void debug_image_writer::post(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopped)
+			return;
+
+		enqueue({ std::string(), cv::Mat(), std::move(job) });
+	}
+	queue_changed.notify_all();
+}
+
+void debug_image_writer::enqueue(entry e)
+{
+	if (!worker.joinable())
+		worker = std::thread(&debug_image_writer::run, this);
+
+	queue.push_back(std::move(e));
+}
+
+void debug_image_writer::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	queue_changed.wait(lock, [this]() { return (queue.empty() && !busy) || !worker.joinable(); });
+}
+
+void debug_image_writer::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		queue_changed.wait(lock, [this]() { return stopped || !queue.empty(); });
+		// pending images are still written on shutdown
+		if (queue.empty())
+			break;
+
+		entry e = std::move(queue.front());
+		queue.pop_front();
+		if (!e.job)
+			images--;
+		busy = true;
+		const int compression = png_compression.load(std::memory_order_relaxed);
+		lock.unlock();
+
+		try {
+			if (e.job)
+				e.job();
+			else
+			{
+				std::filesystem::path parent = std::filesystem::path(e.path).parent_path();
+				if (!parent.empty() && !std::filesystem::exists(parent))
+					std::filesystem::create_directories(parent);
+
+				cv::imwrite(e.path, e.img, { cv::IMWRITE_PNG_COMPRESSION, compression });
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+
+		lock.lock();
+		busy = false;
+		queue_changed.notify_all();
+	}
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core/mat.hpp>
+
+namespace reader
+{
+
+/*
+* Writes debug images on a background thread so that encoding does not
+* distort the latency of the request path.
+* The queue is bounded, if it is full the oldest image is dropped.
+* Writing is a no-op unless enabled (verbose mode).
+* Other file output can be moved off the request path with post().
+*/
+class debug_image_writer
+{
+public:
+	static debug_image_writer& get();
+
+	/* maximal number of images waiting to be written */
+	static const size_t capacity = 32;
+
+	~debug_image_writer();
+
+	/*
+	* Enqueues a copy of @param{img} to be stored at @param{path}
+	*/
+	void write(const std::string& path, const cv::Mat& img);
+
+	/*
+	* Enqueues @param{job} to run on the writer thread, regardless of enabled.
+	* Jobs are never dropped and do not count towards the capacity.
+	*/
+	void post(std::function<void()> job);
+
+	/*
+	* Blocks until all enqueued images are written
+	*/
+	void flush();
+
+	std::atomic<bool> enabled;
+
+	/* PNG compression level from 0 (uncompressed, fastest) to 9 */
+	std::atomic<int> png_compression;
+
+private:
+	debug_image_writer();
+
+	/* an image to write or a posted job */
+	struct entry
+	{
+		std::string path;
+		cv::Mat img;
+		std::function<void()> job;
+	};
+
+	/* requires mutex to be locked */
+	void enqueue(entry e);
+
+	void run();
+
+	std::mutex mutex;
+	std::condition_variable queue_changed;
+	std::deque<entry> queue;
+	/* images in queue */
+	size_t images = 0;
+	bool busy = false;
+	bool stopped = false;
+	std::thread worker;
+};
+
+}
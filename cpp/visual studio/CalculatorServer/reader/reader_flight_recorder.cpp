@@ -0,0 +1,117 @@
+#include "reader_flight_recorder.hpp"
+
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "reader_debug_images.hpp"
+#include "reader_layout.hpp"
+
+namespace reader
+{
+
+flight_recorder::flight_recorder(size_t capacity)
+	:
+	capacity(capacity)
+{
+}
+
+unsigned long long flight_recorder::record(const cv::Mat& screenshot)
+{
+	frame f;
+	f.time = std::chrono::system_clock::now();
+
+	const std::pair<const char*, pane> panes[] = {
+		{ "title", pane::STATISTICS_TITLE },
+		{ "island", pane::STATISTICS_ISLAND },
+		{ "production", pane::STATISTICS_PRODUCTION },
+		{ "hud_population", pane::HUD_POPULATION }
+	};
+
+	const auto plan = layout_plan::for_frame(screenshot.size());
+	for (const auto& p : panes)
+	{
+		try {
+			cv::Mat roi = screenshot(plan->get(p.second));
+			if (!roi.empty())
+				f.panes.emplace_back(p.first, roi.clone());
+		}
+		catch (const cv::Exception&)
+		{
+			// pane outside of the screenshot
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	f.id = next_id++;
+	if (frames.size() >= capacity)
+		frames.pop_front();
+	frames.push_back(std::move(f));
+
+	return frames.back().id;
+}
+
+void flight_recorder::annotate(unsigned long long id, const std::string& results)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto iter = frames.rbegin(); iter != frames.rend(); ++iter)
+	{
+		if (iter->id == id)
+		{
+			iter->results = results;
+			return;
+		}
+	}
+}
+
+std::string flight_recorder::dump(const std::string& reason)
+{
+	// panes are never modified after record, the copy shares their data
+	std::deque<frame> copy;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		copy = frames;
+	}
+
+	std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	std::tm local_time = *std::localtime(&now);
+
+	std::ostringstream directory;
+	directory << "flight_recorder/" << std::put_time(&local_time, "%Y%m%d-%H%M%S") << "-" << reason;
+
+	debug_image_writer::get().post([directory = directory.str(), copy = std::move(copy)]() {
+		try {
+			std::filesystem::create_directories(directory);
+
+			for (const frame& f : copy)
+			{
+				const std::string prefix = directory + "/frame-" + std::to_string(f.id);
+				for (const auto& pane : f.panes)
+					cv::imwrite(prefix + "-" + pane.first + ".png", pane.second, { cv::IMWRITE_PNG_COMPRESSION, 1 });
+
+				std::ofstream results(prefix + ".json");
+				results << (f.results.empty() ? "null" : f.results) << std::endl;
+			}
+
+			std::cout << "Recent frames written to " << directory << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Failed to write recent frames: " << e.what() << std::endl;
+		}
+	});
+
+	return directory.str();
+}
+
+size_t flight_recorder::get_capacity() const
+{
+	return capacity;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+namespace reader
+{
+
+/*
+* Keeps the last frames together with their recognition results in memory
+* and writes them to disk only when a recognition went wrong.
+* Only the panes the readers look at are stored, not the full screenshot.
+*/
+class flight_recorder
+{
+public:
+	struct frame
+	{
+		unsigned long long id;
+		std::chrono::system_clock::time_point time;
+		std::vector<std::pair<std::string, cv::Mat>> panes;
+		std::string results;
+	};
+
+	flight_recorder(size_t capacity = 10);
+
+	/*
+	* Stores the panes of @param{screenshot}, evicts the oldest frame if full
+	* Returns the id of the new frame, ids start at 1
+	*/
+	unsigned long long record(const cv::Mat& screenshot);
+
+	/*
+	* Attaches the (serialized) recognition results to the frame with @param{id}
+	*/
+	void annotate(unsigned long long id, const std::string& results);
+
+	/*
+	* Writes all frames to flight_recorder/<time>-<reason>/ on the debug image writer thread
+	* Returns the directory
+	*/
+	std::string dump(const std::string& reason);
+
+	size_t get_capacity() const;
+
+private:
+	const size_t capacity;
+
+	std::mutex mutex;
+	std::deque<frame> frames;
+	/* 0 is never used so that it can stand for "no frame" */
+	unsigned long long next_id = 1;
+};
+
+}
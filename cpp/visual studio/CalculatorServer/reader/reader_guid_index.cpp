@@ -0,0 +1,165 @@
+#include "reader_guid_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace reader
+{
+
+////////////////////////////////////////
+//
+// Class: guid_index
+//
+////////////////////////////////////////
+
+const size_t guid_index::npos = std::numeric_limits<size_t>::max();
+
+guid_index::guid_index(std::vector<unsigned int> guids)
+	:
+	guids(std::move(guids))
+{
+	std::sort(this->guids.begin(), this->guids.end());
+	this->guids.erase(std::unique(this->guids.begin(), this->guids.end()), this->guids.end());
+}
+
+size_t guid_index::size() const
+{
+	return guids.size();
+}
+
+size_t guid_index::index_of(unsigned int guid) const
+{
+	auto iter = std::lower_bound(guids.begin(), guids.end(), guid);
+	if (iter == guids.end() || *iter != guid)
+		return npos;
+	return iter - guids.begin();
+}
+
+unsigned int guid_index::guid(size_t index) const
+{
+	return guids[index];
+}
+
+const std::vector<unsigned int>& guid_index::get_guids() const
+{
+	return guids;
+}
+
+////////////////////////////////////////
+//
+// Class: guid_values
+//
+////////////////////////////////////////
+
+const int guid_values::missing = std::numeric_limits<int>::min();
+
+guid_values::const_iterator::const_iterator(const guid_values* container, size_t position)
+	:
+	container(container),
+	position(position)
+{
+	skip_missing();
+}
+
+guid_values::value_type guid_values::const_iterator::operator*() const
+{
+	return value_type(container->index->guid(position), container->values[position]);
+}
+
+guid_values::const_iterator::arrow guid_values::const_iterator::operator->() const
+{
+	return arrow{ **this };
+}
+
+guid_values::const_iterator& guid_values::const_iterator::operator++()
+{
+	position++;
+	skip_missing();
+	return *this;
+}
+
+guid_values::const_iterator guid_values::const_iterator::operator++(int)
+{
+	const_iterator result(*this);
+	++*this;
+	return result;
+}
+
+void guid_values::const_iterator::skip_missing()
+{
+	while (position < container->values.size() && container->values[position] == missing)
+		position++;
+}
+
+guid_values::guid_values()
+{
+}
+
+guid_values::guid_values(std::shared_ptr<const guid_index> index)
+	:
+	index(std::move(index)),
+	values(this->index ? this->index->size() : 0, missing)
+{
+}
+
+bool guid_values::emplace(unsigned int guid, int value)
+{
+	if (!index || value == missing)
+		return false;
+
+	const size_t position = index->index_of(guid);
+	if (position == guid_index::npos || values[position] != missing)
+		return false;
+
+	values[position] = value;
+	entries++;
+	return true;
+}
+
+void guid_values::fill_missing(int value)
+{
+	std::replace(values.begin(), values.end(), missing, value);
+	entries = values.size();
+}
+
+int guid_values::at(unsigned int guid) const
+{
+	const size_t position = index ? index->index_of(guid) : guid_index::npos;
+	if (position == guid_index::npos || values[position] == missing)
+		throw std::out_of_range("no value for guid");
+	return values[position];
+}
+
+size_t guid_values::count(unsigned int guid) const
+{
+	const size_t position = index ? index->index_of(guid) : guid_index::npos;
+	return position != guid_index::npos && values[position] != missing;
+}
+
+bool guid_values::empty() const
+{
+	return !entries;
+}
+
+size_t guid_values::size() const
+{
+	return entries;
+}
+
+guid_values::const_iterator guid_values::begin() const
+{
+	return const_iterator(this, 0);
+}
+
+guid_values::const_iterator guid_values::end() const
+{
+	return const_iterator(this, values.size());
+}
+
+const std::shared_ptr<const guid_index>& guid_values::get_index() const
+{
+	return index;
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace reader
+{
+
+/*
+* Maps the sparse GUIDs of one category (e.g. buildings) to dense indices 0, ..., size() - 1
+* Indices are assigned in ascending order of the GUIDs.
+*/
+class guid_index
+{
+public:
+	static const size_t npos;
+
+	explicit guid_index(std::vector<unsigned int> guids);
+
+	size_t size() const;
+
+	/*
+	* Returns npos if @param{guid} is not part of the index
+	*/
+	size_t index_of(unsigned int guid) const;
+
+	unsigned int guid(size_t index) const;
+
+	const std::vector<unsigned int>& get_guids() const;
+
+private:
+	std::vector<unsigned int> guids;
+};
+
+/*
+* One integer per GUID of a guid_index, stored in a flat vector.
+* Behaves like a read only std::map<unsigned int, int>: iteration yields (GUID, value)
+* pairs in ascending order of the GUIDs and skips entries without value.
+*/
+class guid_values
+{
+public:
+	typedef std::pair<unsigned int, int> value_type;
+
+	/* marks entries without value, results are never negative */
+	static const int missing;
+
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef guid_values::value_type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const value_type* pointer;
+		typedef value_type reference;
+
+		/* operator-> of an iterator that yields values */
+		struct arrow
+		{
+			value_type entry;
+			const value_type* operator->() const { return &entry; }
+		};
+
+		const_iterator(const guid_values* container, size_t position);
+
+		value_type operator*() const;
+		arrow operator->() const;
+		const_iterator& operator++();
+		const_iterator operator++(int);
+
+		bool operator==(const const_iterator& other) const { return position == other.position; }
+		bool operator!=(const const_iterator& other) const { return position != other.position; }
+
+	private:
+		/* moves forward to the next entry with value */
+		void skip_missing();
+
+		const guid_values* container;
+		size_t position;
+	};
+
+	/* empty, values cannot be added */
+	guid_values();
+	explicit guid_values(std::shared_ptr<const guid_index> index);
+
+	/*
+	* Sets the value of @param{guid} unless it already has one
+	* Returns false if the value was not set or @param{guid} is not part of the index
+	*/
+	bool emplace(unsigned int guid, int value);
+
+	/*
+	* Assigns @param{value} to all GUIDs of the index that have no value
+	*/
+	void fill_missing(int value);
+
+	/*
+	* Throws std::out_of_range if @param{guid} has no value
+	*/
+	int at(unsigned int guid) const;
+
+	size_t count(unsigned int guid) const;
+
+	bool empty() const;
+	size_t size() const;
+
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	const std::shared_ptr<const guid_index>& get_index() const;
+
+private:
+	std::shared_ptr<const guid_index> index;
+	std::vector<int> values;
+	size_t entries = 0;
+};
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "reader_guid_index.hpp"
+#include "reader_layout.hpp"
 #include "reader_util.hpp"
 
 namespace reader
@@ -8,13 +10,8 @@ namespace reader
 class hud_params
 {
 public:
+	/* the icon and text positions are listed in hud_population_icons and hud_population_texts */
 	static const cv::Scalar background_brown_light;
-
-	static const cv::Rect2f position_population_top_icon;
-	static const cv::Rect2f position_population_bottom_icon;
-
-	/* pane rectangles relative to [0,1] image */
-	static const cv::Rect2f pane_population;
 };
 
 class hud_statistics
@@ -29,7 +26,7 @@ public:
 *
 * returns a map with entries for all detected population types referred by their GUID
 */
-	std::map < unsigned int, int> get_population_amount() const;
+	guid_values get_population_amount() const;
 
 	std::string get_selected_island() const;
 
@@ -37,6 +34,8 @@ public:
 private:
 	image_recognition& recog;
 	cv::Mat screenshot;
+	/* rectangles of the slots for the size of the last screenshot */
+	std::shared_ptr<const layout_plan> plan;
 	std::string selected_island;
 };
 
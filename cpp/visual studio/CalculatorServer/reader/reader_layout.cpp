@@ -0,0 +1,101 @@
+#include "reader_layout.hpp"
+
+#include <cmath>
+
+namespace reader
+{
+
+////////////////////////////////////////
+//
+// Class: layout_plan
+//
+////////////////////////////////////////
+
+std::mutex layout_plan::last_mutex;
+std::shared_ptr<const layout_plan> layout_plan::last;
+
+layout_plan::layout_plan(cv::Size frame)
+	:
+	frame(frame)
+{
+	for (size_t i = 0; i < panes.size(); i++)
+		panes[i] = resolve(pane_table[i], frame);
+
+	for (size_t i = 0; i < hud_population_slots; i++)
+	{
+		hud_population_icon_rects[i] = resolve_square(hud_population_icons[i], frame);
+		hud_population_text_rects[i] = resolve(hud_population_texts[i], frame);
+	}
+}
+
+std::shared_ptr<const layout_plan> layout_plan::for_frame(cv::Size frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(last_mutex);
+		if (last && last->frame == frame)
+			return last;
+	}
+
+	// concurrent callers may both compute the plan, they are equal
+	auto plan = std::make_shared<const layout_plan>(frame);
+	std::lock_guard<std::mutex> lock(last_mutex);
+	last = plan;
+	return plan;
+}
+
+cv::Size layout_plan::get_frame_size() const
+{
+	return frame;
+}
+
+const cv::Rect& layout_plan::get(pane p) const
+{
+	return panes[static_cast<size_t>(p)];
+}
+
+const cv::Rect& layout_plan::get_hud_population_icon(size_t slot) const
+{
+	return hud_population_icon_rects.at(slot);
+}
+
+const cv::Rect& layout_plan::get_hud_population_text(size_t slot) const
+{
+	return hud_population_text_rects.at(slot);
+}
+
+cv::Rect layout_plan::resolve(const relative_rect& rect, cv::Size frame)
+{
+	if (frame.empty())
+		return cv::Rect();
+
+	float rows = frame.height - 1.f;
+	float normal_cols = 16 * rows / 9.f;
+
+	return cv::Rect(static_cast<int>(left(rect, frame)), static_cast<int>(rect.y * rows), static_cast<int>(rect.width * normal_cols), static_cast<int>(rect.height * rows));
+}
+
+cv::Rect layout_plan::resolve_square(const relative_rect& rect, cv::Size frame)
+{
+	if (frame.empty())
+		return cv::Rect();
+
+	int dim = static_cast<int>(std::lround(rect.height * frame.height));
+	return cv::Rect(static_cast<int>(left(rect, frame)), static_cast<int>(rect.y * frame.height), dim, dim);
+}
+
+float layout_plan::left(const relative_rect& rect, cv::Size frame)
+{
+	float cols = frame.width - 1.f;
+	float rows = frame.height - 1.f;
+	float normal_cols = 16 * rows / 9.f;
+
+	float x = normal_cols * rect.x;
+	if (rect.x + 0.5f * rect.width > right_aligned_start) // right aligned
+		x = cols - normal_cols + x;
+	else if (rect.x + 0.5f * rect.width > left_aligned_end) // center aligned
+		x = x - 0.5f * normal_cols + 0.5f * cols;
+
+	return x;
+}
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core/mat.hpp>
+
+namespace reader
+{
+
+/*
+* Rectangles whose horizontal center lies left of left_aligned_end (relative to the 16:9 width)
+* are aligned to the left border, those right of right_aligned_start to the right border
+* and the others to the center (see layout_plan::resolve)
+*/
+constexpr float left_aligned_end = 0.33f;
+constexpr float right_aligned_start = 0.66f;
+
+/*
+* Rectangle relative to the 16:9 part of a screenshot, coordinates from [0,1]x[0,1].
+*/
+struct relative_rect
+{
+	float x;
+	float y;
+	float width;
+	float height;
+
+	static constexpr relative_rect from_corners(float x1, float y1, float x2, float y2)
+	{
+		return relative_rect{ x1, y1, x2 - x1, y2 - y1 };
+	}
+
+	operator cv::Rect2f() const { return cv::Rect2f(x, y, width, height); }
+};
+
+/*
+* Named regions of the UI the readers look at
+*/
+enum class pane
+{
+	STATISTICS_TITLE,
+	STATISTICS_ISLAND,
+	STATISTICS_PRODUCTION,
+	/* size of a building box in the production pane */
+	STATISTICS_FRAMED_ICON,
+	HUD_POPULATION,
+	COUNT
+};
+
+/* indexed by pane */
+constexpr relative_rect pane_table[] = {
+	relative_rect::from_corners(0.35460f, 0.15582f, 0.43390f, 0.18032f),
+	relative_rect::from_corners(0.45350f, 0.19592f, 0.53259f, 0.21295f),
+	relative_rect::from_corners(0.26210f, 0.37516f, 0.45077f, 0.81145f),
+	relative_rect::from_corners(0.26455f, 0.38384f, 0.29399f, 0.43520f),
+	relative_rect::from_corners(0.12792f, 0.73848f, 0.18238f, 0.98427f)
+};
+static_assert(sizeof(pane_table) / sizeof(pane_table[0]) == static_cast<size_t>(pane::COUNT), "one rectangle per pane");
+
+constexpr const relative_rect& relative(pane p)
+{
+	return pane_table[static_cast<size_t>(p)];
+}
+
+/* population levels listed in the HUD, from bottom to top */
+constexpr size_t hud_population_slots = 7;
+
+/* square icons, the bottom and top one are measured, the others are interpolated */
+constexpr std::array<relative_rect, hud_population_slots> make_hud_population_icons()
+{
+	constexpr relative_rect bottom = relative_rect::from_corners(0.12629f, 0.89781f, 0.13903f, 0.92024f);
+	constexpr relative_rect top = relative_rect::from_corners(0.12656f, 0.73929f, 0.13906f, 0.76188f);
+
+	std::array<relative_rect, hud_population_slots> result{};
+	for (size_t i = 0; i < hud_population_slots; i++)
+		result[i] = relative_rect{ bottom.x, bottom.y + i / 6.f * (top.y - bottom.y), bottom.width, bottom.height };
+	return result;
+}
+
+constexpr std::array<relative_rect, hud_population_slots> hud_population_icons = make_hud_population_icons();
+
+/* amount right of each icon */
+constexpr std::array<relative_rect, hud_population_slots> make_hud_population_texts()
+{
+	std::array<relative_rect, hud_population_slots> result{};
+	for (size_t i = 0; i < hud_population_slots; i++)
+	{
+		const relative_rect& icon = hud_population_icons[i];
+		result[i] = relative_rect{ icon.x + 1.5f * icon.width, icon.y + 0.2f * icon.height, 2.7f * icon.width, 0.75f * icon.height };
+	}
+	return result;
+}
+
+constexpr std::array<relative_rect, hud_population_slots> hud_population_texts = make_hud_population_texts();
+
+/*
+* Pixel rectangles of all panes and icon slots for one frame size.
+* Plans are immutable, for_frame() reuses the last one until the resolution changes.
+*/
+class layout_plan
+{
+public:
+	explicit layout_plan(cv::Size frame);
+
+	/*
+	* Returns the plan for frames of size @param{frame}, computes it if the size differs from the last call
+	*/
+	static std::shared_ptr<const layout_plan> for_frame(cv::Size frame);
+
+	cv::Size get_frame_size() const;
+
+	const cv::Rect& get(pane p) const;
+	const cv::Rect& get_hud_population_icon(size_t slot) const;
+	const cv::Rect& get_hud_population_text(size_t slot) const;
+
+	/*
+	* Converts @param{rect} to pixels of a frame with size @param{frame}
+	*/
+	static cv::Rect resolve(const relative_rect& rect, cv::Size frame);
+
+	/*
+	* Like resolve, but the result is a square with the height of @param{rect}
+	*/
+	static cv::Rect resolve_square(const relative_rect& rect, cv::Size frame);
+
+private:
+	/*
+	* Returns the left border of @param{rect} in pixels, the 16:9 part is centered in wider frames
+	*/
+	static float left(const relative_rect& rect, cv::Size frame);
+
+	cv::Size frame;
+	std::array<cv::Rect, static_cast<size_t>(pane::COUNT)> panes;
+	std::array<cv::Rect, hud_population_slots> hud_population_icon_rects;
+	std::array<cv::Rect, hud_population_slots> hud_population_text_rects;
+
+	static std::mutex last_mutex;
+	/* guarded by last_mutex */
+	static std::shared_ptr<const layout_plan> last;
+};
+
+}
@@ -0,0 +1,186 @@
+#include "reader_metrics.hpp"
+
+#include <sstream>
+
+#include "reader_trace.hpp"
+
+namespace reader
+{
+
+////////////////////////////////////////
+//
+// Class: latency_histogram
+//
+////////////////////////////////////////
+
+latency_histogram::latency_histogram()
+	:
+	sum_ns(0),
+	count(0)
+{
+	for (auto& bucket : buckets)
+		bucket = 0;
+}
+
+void latency_histogram::record(std::chrono::nanoseconds duration)
+{
+	const unsigned long long ns = duration.count() > 0 ? static_cast<unsigned long long>(duration.count()) : 0;
+
+	size_t bucket = 0;
+	unsigned long long bound = 100000;
+	while (bucket + 1 < bucket_count && ns > bound)
+	{
+		bound *= 2;
+		bucket++;
+	}
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	sum_ns.fetch_add(ns, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+}
+
+double latency_histogram::upper_bound_seconds(size_t bucket)
+{
+	return 0.0001 * static_cast<double>(1ull << bucket);
+}
+
+////////////////////////////////////////
+//
+// Class: metrics
+//
+////////////////////////////////////////
+
+metrics::metrics()
+	:
+	enabled(true)
+{
+	for (auto& c : counters)
+		c = 0;
+}
+
+metrics& metrics::get()
+{
+	static metrics instance;
+	return instance;
+}
+
+void metrics::record(stage s, std::chrono::nanoseconds duration)
+{
+	if (enabled.load(std::memory_order_relaxed))
+		histograms[static_cast<size_t>(s)].record(duration);
+}
+
+void metrics::increment(counter c, unsigned long long amount)
+{
+	if (enabled.load(std::memory_order_relaxed))
+		counters[static_cast<size_t>(c)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+unsigned long long metrics::get(counter c) const
+{
+	return counters[static_cast<size_t>(c)].load(std::memory_order_relaxed);
+}
+
+const latency_histogram& metrics::get(stage s) const
+{
+	return histograms[static_cast<size_t>(s)];
+}
+
+std::string metrics::to_prometheus() const
+{
+	std::ostringstream out;
+
+	out << "# HELP anno_stage_duration_seconds Duration of the recognition pipeline stages." << std::endl
+		<< "# TYPE anno_stage_duration_seconds histogram" << std::endl;
+
+	for (size_t i = 0; i < histograms.size(); i++)
+	{
+		const auto& histogram = histograms[i];
+		const char* label = name(static_cast<stage>(i));
+
+		unsigned long long cumulative = 0;
+		for (size_t b = 0; b + 1 < latency_histogram::bucket_count; b++)
+		{
+			cumulative += histogram.buckets[b].load(std::memory_order_relaxed);
+			out << "anno_stage_duration_seconds_bucket{stage=\"" << label << "\",le=\""
+				<< latency_histogram::upper_bound_seconds(b) << "\"} " << cumulative << std::endl;
+		}
+		cumulative += histogram.buckets[latency_histogram::bucket_count - 1].load(std::memory_order_relaxed);
+		out << "anno_stage_duration_seconds_bucket{stage=\"" << label << "\",le=\"+Inf\"} " << cumulative << std::endl;
+		out << "anno_stage_duration_seconds_sum{stage=\"" << label << "\"} "
+			<< histogram.sum_ns.load(std::memory_order_relaxed) * 1e-9 << std::endl;
+		out << "anno_stage_duration_seconds_count{stage=\"" << label << "\"} " << cumulative << std::endl;
+	}
+
+	for (size_t i = 0; i < counters.size(); i++)
+	{
+		const char* counter_name = name(static_cast<counter>(i));
+		out << "# TYPE anno_" << counter_name << "_total counter" << std::endl
+			<< "anno_" << counter_name << "_total " << counters[i].load(std::memory_order_relaxed) << std::endl;
+	}
+
+	return out.str();
+}
+
+const char* metrics::name(stage s)
+{
+	switch (s)
+	{
+	case stage::RECOGNITION: return "recognition";
+	case stage::FIND_ANNO: return "find_anno";
+	case stage::TAKE_SCREENSHOT: return "take_screenshot";
+	case stage::STATISTICS_SCREEN: return "statistics_screen";
+	case stage::HUD: return "hud";
+	case stage::DETECT_BOXES: return "detect_boxes";
+	case stage::ICON_MATCHING: return "icon_matching";
+	case stage::OCR: return "ocr";
+	case stage::OCR_TIMEOUT: return "ocr_timeout";
+	default: return "unknown";
+	}
+}
+
+const char* metrics::name(counter c)
+{
+	switch (c)
+	{
+	case counter::OCR_CALLS: return "ocr_calls";
+	case counter::CACHE_HITS: return "cache_hits";
+	case counter::SNAPSHOT_HITS: return "snapshot_hits";
+	case counter::NOT_MODIFIED: return "not_modified";
+	case counter::FRAMES_SKIPPED: return "frames_skipped";
+	case counter::RECOGNITIONS_CANCELED: return "recognitions_canceled";
+	case counter::OCR_TIMEOUTS: return "ocr_timeouts";
+	case counter::REQUESTS_REJECTED: return "requests_rejected";
+	case counter::REQUESTS_TIMED_OUT: return "requests_timed_out";
+	case counter::DEBUG_IMAGES_DROPPED: return "debug_images_dropped";
+	default: return "unknown";
+	}
+}
+
+////////////////////////////////////////
+//
+// Class: scoped_timer
+//
+////////////////////////////////////////
+
+scoped_timer::scoped_timer(stage s)
+	:
+	s(s),
+	active(metrics::get().enabled.load(std::memory_order_relaxed)),
+	traced(trace::get().enabled.load(std::memory_order_relaxed))
+{
+	if (traced)
+		trace::get().begin(metrics::name(s));
+	if (active)
+		start = std::chrono::steady_clock::now();
+}
+
+scoped_timer::~scoped_timer()
+{
+	if (active)
+		metrics::get().record(s, std::chrono::steady_clock::now() - start);
+	if (traced)
+		trace::get().end(metrics::name(s));
+}
+
+}
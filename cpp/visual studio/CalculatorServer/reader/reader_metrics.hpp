@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace reader
+{
+
+/*
+* Stages of the recognition pipeline whose latency is recorded
+*/
+enum class stage
+{
+	RECOGNITION, // complete capture and recognition cycle
+	FIND_ANNO,
+	TAKE_SCREENSHOT,
+	STATISTICS_SCREEN,
+	HUD,
+	DETECT_BOXES,
+	ICON_MATCHING,
+	OCR,
+	OCR_TIMEOUT, // OCR calls aborted after ocr_timeout, measured until the abort
+	COUNT
+};
+
+enum class counter
+{
+	OCR_CALLS,
+	CACHE_HITS, // requests served from a recognition started by another request
+	SNAPSHOT_HITS, // requests served from the latest published result without a recognition
+	NOT_MODIFIED, // requests answered with 304
+	FRAMES_SKIPPED, // recognitions aborted because no game window was found
+	RECOGNITIONS_CANCELED, // recognitions aborted because all waiting clients left
+	OCR_TIMEOUTS, // OCR calls aborted because they exceeded ocr_timeout
+	REQUESTS_REJECTED,
+	REQUESTS_TIMED_OUT, // requests answered with 503 because their recognition exceeded wait_timeout
+	DEBUG_IMAGES_DROPPED,
+	COUNT
+};
+
+/*
+* Histogram of durations with exponentially growing buckets.
+* Recording is lock-free and may happen concurrently with reading.
+*/
+class latency_histogram
+{
+public:
+	/* upper bound of bucket i is 100us * 2^i, the last bucket is unbounded */
+	static const size_t bucket_count = 18;
+
+	latency_histogram();
+
+	void record(std::chrono::nanoseconds duration);
+
+	static double upper_bound_seconds(size_t bucket);
+
+	std::array<std::atomic<unsigned long long>, bucket_count> buckets;
+	std::atomic<unsigned long long> sum_ns;
+	std::atomic<unsigned long long> count;
+};
+
+/*
+* Process wide latency histograms and counters
+* exported in Prometheus text format
+*/
+class metrics
+{
+public:
+	static metrics& get();
+
+	void record(stage s, std::chrono::nanoseconds duration);
+	void increment(counter c, unsigned long long amount = 1);
+
+	unsigned long long get(counter c) const;
+	const latency_histogram& get(stage s) const;
+
+	/*
+	* Returns all metrics in the Prometheus text exposition format
+	*/
+	std::string to_prometheus() const;
+
+	std::atomic<bool> enabled;
+
+	static const char* name(stage s);
+	static const char* name(counter c);
+
+private:
+	metrics();
+
+	std::array<latency_histogram, static_cast<size_t>(stage::COUNT)> histograms;
+	std::array<std::atomic<unsigned long long>, static_cast<size_t>(counter::COUNT)> counters;
+};
+
+/*
+* Records the time between construction and destruction for the given stage,
+* also emits trace events if tracing is enabled
+*/
+class scoped_timer
+{
+public:
+	scoped_timer(stage s);
+	~scoped_timer();
+
+	scoped_timer(const scoped_timer&) = delete;
+	scoped_timer& operator=(const scoped_timer&) = delete;
+
+private:
+	stage s;
+	bool active;
+	bool traced;
+	std::chrono::steady_clock::time_point start;
+};
+
+}
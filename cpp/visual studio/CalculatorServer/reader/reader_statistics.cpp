@@ -4,52 +4,108 @@
 
 namespace reader
 {
-statistics::statistics(image_recognition& recog)
+statistics::statistics(image_recognition& recog, std::shared_ptr<thread_pool> pool)
 	:
 	recog(recog),
 	stats_screen(recog),
-	hud(recog)
+	hud(recog),
+	pool(std::move(pool)),
+	img(nullptr),
+	fields(FIELD_ALL),
+	progress(nullptr),
+	pending_boxes(0)
 {
+	// the title decides whether the statistics screen is open, the HUD is only read if it is not
+	const auto title = stages.add("statistics_title", [this]() {
+		stats_screen.update(language, *img);
+		});
+
+	stages.add("hud_population", [this]() {
+		if (!(fields & FIELD_POPULATION) || stats_screen.is_open())
+			return;
+		hud.update(language, *img);
+		hud_population = hud.get_population_amount();
+		}, { title });
+
+	stages.add("selected_island", [this]() {
+		if (!(fields & FIELD_ISLAND))
+			return;
+		if (recog.is_verbose()) {
+			std::cout << "Island:\t";
+		}
+		if (stats_screen.is_open())
+			selected_island = stats_screen.get_selected_island();
+		else // statistics screen not open
+			selected_island = hud.get_selected_island();
+		}, { title });
+
+	stages.add("building_grid", [this]() {
+		if (!(fields & FIELD_BUILDINGS))
+			return;
+		stats_screen.read_existing_buildings(*progress, deadline);
+		buildings = progress->buildings;
+		pending_boxes = progress->pending();
+		}, { title });
+
+	stages.add("productivities", [this]() {
+		if (!(fields & FIELD_PRODUCTIVITIES))
+			return;
+		productivities = stats_screen.get_average_productivities();
+		}, { title });
 }
 
-void statistics::update(const std::string& language, const cv::Mat& img)
+void statistics::update(const std::string& language, const cv::Mat& img, field_set fields)
 {
-	stats_screen.update(language, img);
-	hud.update(language, img);
+	building_progress complete;
+	update(language, img, fields, complete, std::chrono::steady_clock::time_point::max());
 }
 
-std::map<unsigned int, int> statistics::get_population_amount()
+void statistics::update(const std::string& language, const cv::Mat& img, field_set fields,
+	building_progress& progress, std::chrono::steady_clock::time_point deadline)
 {
+	selected_island.clear();
+	hud_population = guid_values();
+	buildings = guid_values();
+	productivities = guid_values();
+	pending_boxes = 0;
+
+	// switch the OCR language before the stages share it
+	recog.update(language);
+
+	this->language = language;
+	this->img = &img;
+	this->fields = fields;
+	this->progress = &progress;
+	this->deadline = deadline;
+	stages.run(pool.get());
+	this->progress = nullptr;
+}
+
+guid_values statistics::get_population_amount()
+{
+	if (!(fields & FIELD_POPULATION))
+		return guid_values();
+
 	if (stats_screen.is_open())
 		return stats_screen.get_population_amount();
 	else
-		return hud.get_population_amount();
+		return hud_population;
 }
 
-std::map<unsigned int, int> statistics::get_average_productivities()
+guid_values statistics::get_average_productivities()
 {
-	return stats_screen.get_average_productivities();
+	return productivities;
 }
 
 
 std::string statistics::get_selected_island()
 {
+	return selected_island;
+}
 
-
-	if (recog.is_verbose()) {
-		std::cout << "Island:\t";
-	}
-	if (stats_screen.is_open())
-	{
-		return stats_screen.get_selected_island();
-
-	}
-	else // statistics screen not open
-	{
-		return hud.get_selected_island();
-	}
-
-	return std::string();
+size_t statistics::get_pending_boxes() const
+{
+	return pending_boxes;
 }
 
 
@@ -64,9 +120,9 @@ bool statistics::has_language(const std::string& language)
 	return recog.has_language(language);
 }
 
-std::map<unsigned int, int> statistics::get_assets_existing_buildings()
+guid_values statistics::get_assets_existing_buildings()
 {
-	return stats_screen.get_assets_existing_buildings();
+	return buildings;
 }
 
 }
@@ -1,26 +1,62 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <map>
+#include <memory>
 
 #include "reader_statistics_screen.hpp"
 #include "reader_hud_statistics.hpp"
+#include "reader_task_graph.hpp"
 
 namespace reader
 {
 
+/*
+* Values read by statistics, combined to select the ones update() computes
+*/
+enum field : unsigned int
+{
+	FIELD_ISLAND = 1,
+	FIELD_POPULATION = 2,
+	FIELD_BUILDINGS = 4,
+	FIELD_PRODUCTIVITIES = 8,
+	FIELD_ALL = 15
+};
+typedef unsigned int field_set;
+
+/*
+* Reads all values from a screenshot in update(), the getters return the results.
+* The stages (title, island, building grid, population HUD) are run as task graph,
+* independent ones concurrently if a thread pool is passed.
+*/
 class statistics 
 {
 public:
-	statistics(image_recognition& recog);
+	statistics(image_recognition& recog, std::shared_ptr<thread_pool> pool = nullptr);
+
+	/* the stages refer to this instance */
+	statistics(const statistics&) = delete;
+	statistics& operator=(const statistics&) = delete;
+
+	/*
+	* Runs only the stages the requested @param{fields} depend on,
+	* the getters of the other fields return empty values
+	*/
+	void update(const std::string& language, const cv::Mat& img, field_set fields = FIELD_ALL);
 
-	void update(const std::string& language, const cv::Mat& img);
+	/*
+	* Like update, but the building counts are read box by box until @param{deadline}
+	* and continue the reading stored in @param{progress}. The other stages always finish.
+	*/
+	void update(const std::string& language, const cv::Mat& img, field_set fields,
+		building_progress& progress, std::chrono::steady_clock::time_point deadline);
 
 	/**
 *
 * returns a map with entries for all detected population types referred by their GUID
 */
-	std::map < unsigned int, int> get_population_amount();
+	guid_values get_population_amount();
 
 
 
@@ -28,15 +64,20 @@ public:
 * Returns count of existing buildings (houses/buildings).
 * Returns an empty map in case no information is found.
 */
-	std::map < unsigned int, int> get_assets_existing_buildings();
+	guid_values get_assets_existing_buildings();
 
 	/*
 * Returns percentile productivity for buildings.
 * Returns an empty map in case no information is found.
 */
-	std::map < unsigned int, int> get_average_productivities();
+	guid_values get_average_productivities();
 
 	std::string get_selected_island();
+
+	/*
+	* Returns the number of building boxes the last update did not read before its deadline
+	*/
+	size_t get_pending_boxes() const;
 	
 	const keyword_dictionary& get_dictionary();
 	bool has_language(const std::string& language);
@@ -46,5 +87,22 @@ private:
 	statistics_screen stats_screen;
 	hud_statistics hud;
 
+	std::shared_ptr<thread_pool> pool;
+	task_graph stages;
+
+	/* input of the running update */
+	std::string language;
+	const cv::Mat* img;
+	field_set fields;
+	building_progress* progress;
+	std::chrono::steady_clock::time_point deadline;
+
+	/* results of the last update */
+	std::string selected_island;
+	guid_values hud_population;
+	guid_values buildings;
+	guid_values productivities;
+	size_t pending_boxes;
+
 };
 }
\ No newline at end of file
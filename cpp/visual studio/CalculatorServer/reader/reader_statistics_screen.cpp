@@ -9,6 +9,11 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "reader_assets.hpp"
+#include "reader_debug_images.hpp"
+#include "reader_metrics.hpp"
+#include "reader_trace.hpp"
+
 namespace reader
 {
 ////////////////////////////////////////
@@ -20,12 +25,7 @@ namespace reader
 const cv::Scalar statistics_screen_params::background_brown_dark = cv::Scalar(29,45,58,255);
 const cv::Scalar statistics_screen_params::icon_background = cv::Scalar(184,196,198,255);
 
-const cv::Rect2f statistics_screen_params::size_framed_icon = cv::Rect2f(cv::Point2f(0.26455f, 0.38384f), cv::Point2f(0.29399f, 0.43520f));
 const cv::Rect2f statistics_screen_params::size_icon = cv::Rect2f(0.068493151f, 0.068493151f, 0.8630137f, 0.8630137f);
-	
-const cv::Rect2f statistics_screen_params::pane_title = cv::Rect2f(cv::Point2f(0.35460f, 0.15582f), cv::Point2f(0.43390f, 0.18032f));
-const cv::Rect2f statistics_screen_params::pane_island = cv::Rect2f(cv::Point2f(0.45350f, 0.19592f), cv::Point2f(0.53259f, 0.21295f));
-const cv::Rect2f statistics_screen_params::pane_production_left = cv::Rect2f(cv::Point2f(0.26210f, 0.37516f), cv::Point2f(0.45077f, 0.81145f));
 
 const unsigned int statistics_screen_params::count_cols = 5;
 
@@ -49,14 +49,16 @@ statistics_screen::statistics_screen(image_recognition& recog)
 
 void statistics_screen::update(const std::string& language, const cv::Mat& img)
 {
+	scoped_timer timer(stage::STATISTICS_SCREEN);
+
 	selected_island = std::string();
 
 	recog.update(language);
 
-	cv::Mat statistics_text_img = recog.binarize(recog.get_pane(statistics_screen_params::pane_title, img), true);
+	plan = layout_plan::for_frame(img.size());
+	cv::Mat statistics_text_img = recog.binarize(img(plan->get(pane::STATISTICS_TITLE)), true);
 	if (recog.is_verbose()) {
-		cv::imwrite("debug_images/statistics_text.png", statistics_text_img);
-		cv::imwrite("debug_images/statistics_screenshot.png", img);
+		debug_image_writer::get().write("debug_images/statistics_text.png", statistics_text_img);
 	}
 	if (recog.get_guid_from_name(statistics_text_img, recog.make_dictionary({ phrase::REEVES_BOOK })).empty())
 	{
@@ -97,16 +99,16 @@ bool statistics_screen::is_all_islands_selected()
 
 
 
-std::map<unsigned int, int> statistics_screen::get_population_amount() const
+guid_values statistics_screen::get_population_amount() const
 {
-	return std::map<unsigned int, int>();
+	return guid_values(recog.get_assets().population_index);
 }
 
-std::map<unsigned int, int> statistics_screen::get_average_productivities()
+guid_values statistics_screen::get_average_productivities()
 {
 	const cv::Mat& im = screenshot;
 
-	 return std::map<unsigned int, int>();
+	 return guid_values(recog.get_assets().building_index);
 	/*
 	if (get_open_tab() != statistics_screen::tab::PRODUCTION)
 		return result;
@@ -136,7 +138,7 @@ std::map<unsigned int, int> statistics_screen::get_average_productivities()
 			}
 			cv::Scalar background_color = statistics_screen::is_selected(product_icon.at<cv::Vec4b>(0, 0)) ? statistics_screen_params::background_blue_dark : statistics_screen_params::background_brown_light;
 
-			std::vector<unsigned int> p_guids = recog.get_guid_from_icon(product_icon, recog.product_icons, background_color);
+			std::vector<unsigned int> p_guids = recog.get_guid_from_icon(product_icon, recog.get_assets().product_icons, background_color);
 			if (p_guids.empty())
 				return;
 
@@ -159,9 +161,16 @@ std::map<unsigned int, int> statistics_screen::get_average_productivities()
 
 			if (prod >= 0)
 			{
+				const auto& product_to_factories = recog.get_assets().product_to_factories;
 				for (unsigned int p_guid : p_guids)
-					for (unsigned int f_guid : recog.product_to_factories[p_guid])
+				{
+					auto factories = product_to_factories.find(p_guid);
+					if (factories == product_to_factories.end())
+						continue;
+
+					for (unsigned int f_guid : factories->second)
 						result.emplace(f_guid, prod);
+				}
 			}
 
 
@@ -176,15 +185,25 @@ std::map<unsigned int, int> statistics_screen::get_average_productivities()
 	*/
 }
 
-std::map<unsigned int, int> statistics_screen::get_assets_existing_buildings()
+guid_values statistics_screen::get_assets_existing_buildings()
 {
-	if(!is_open())
-		return std::map<unsigned int, int>();
+	building_progress progress;
+	read_existing_buildings(progress, std::chrono::steady_clock::time_point::max());
+	return progress.buildings;
+}
+
+void statistics_screen::read_existing_buildings(building_progress& progress, std::chrono::steady_clock::time_point deadline)
+{
+	if (!is_open())
+	{
+		progress = building_progress();
+		progress.buildings = guid_values(recog.get_assets().building_index);
+		return;
+	}
 
-	std::map<unsigned int, int> result;
-	cv::Mat icon_dummy = recog.get_pane(statistics_screen_params::size_framed_icon, screenshot);
-	cv::Rect2i offering_size = cv::Rect2i(0, 0, icon_dummy.cols, icon_dummy.rows);
-	cv::Mat production_img = recog.get_pane(statistics_screen_params::pane_production_left, screenshot);
+	const cv::Rect& framed_icon = plan->get(pane::STATISTICS_FRAMED_ICON);
+	cv::Rect2i offering_size = cv::Rect2i(0, 0, framed_icon.width, framed_icon.height);
+	cv::Mat production_img = screenshot(plan->get(pane::STATISTICS_PRODUCTION));
 	std::vector<cv::Rect2i> boxes(recog.detect_boxes(production_img, offering_size,cv::Rect2i(), 0.1f));
 
 	std::sort(boxes.begin(), boxes.end(), [&offering_size](const cv::Rect2i& lhs, const cv::Rect2i& rhs) {
@@ -197,8 +216,25 @@ std::map<unsigned int, int> statistics_screen::get_assets_existing_buildings()
 		return false;
 		});
 
-	for (const cv::Rect2i& box : boxes)
+	// the same island shows the same name, small differences stem from the background
+	cv::Mat island = recog.binarize(screenshot(plan->get(pane::STATISTICS_ISLAND)), true);
+	const bool same_island = progress.island.size() == island.size() && progress.island.type() == island.type() &&
+		cv::countNonZero(progress.island != island) <= static_cast<int>(island.total() / 100);
+
+	if (!progress.pending() || progress.boxes != boxes || !same_island)
+	{
+		progress.island = island;
+		progress.boxes = std::move(boxes);
+		progress.next = 0;
+		progress.buildings = guid_values(recog.get_assets().building_index);
+	}
+
+	const size_t first = progress.next;
+	for (; progress.next < progress.boxes.size() && (progress.next == first || std::chrono::steady_clock::now() < deadline); progress.next++)
 	{
+		trace_scope box_scope("building_box");
+		const cv::Rect2i& box = progress.boxes[progress.next];
+
 		float dim = std::min(box.width, box.height);
 		const auto& s = statistics_screen_params::size_icon;
 		cv::Mat icon = production_img(cv::Rect2i(box.x + dim * s.x, box.y + dim * s.y, dim * s.width, dim * s.height));
@@ -210,8 +246,13 @@ std::map<unsigned int, int> statistics_screen::get_assets_existing_buildings()
 		
 		std::vector<unsigned int> building_candidates = recog.get_guid_from_icon(
 			icon,
-			recog.building_icons,
+			recog.get_assets().building_icons,
 			statistics_screen_params::icon_background);
+		if (recog.is_verbose()) {
+			for (unsigned int guid : building_candidates)
+				std::cout << guid << ", ";
+			std::cout << "\t";
+		}
 
 		if (building_candidates.empty() || box.y + 1.5f * box.height >= production_img.rows)
 			continue;
@@ -226,10 +267,8 @@ std::map<unsigned int, int> statistics_screen::get_assets_existing_buildings()
 			int count = recog.number_from_region(count_img);
 			if(count > 0)
 		
-			result.emplace(building_candidates.front(), count);
+			progress.buildings.emplace(building_candidates.front(), count);
 	}
-
-	return result;
 }
 
 
@@ -238,9 +277,9 @@ std::string statistics_screen::get_selected_island()
 	if (!selected_island.empty())
 		return selected_island;
 
-	cv::Mat roi = recog.binarize(recog.get_pane(statistics_screen_params::pane_island, screenshot), true);
+	cv::Mat roi = recog.binarize(screenshot(plan->get(pane::STATISTICS_ISLAND)), true);
 	if (recog.is_verbose()) {
-		cv::imwrite("debug_images/selected_island.png", roi);
+		debug_image_writer::get().write("debug_images/selected_island.png", roi);
 	}
 
 	if (!recog.get_guid_from_name(roi, recog.make_dictionary({ phrase::WORLD_STATISTICS })).empty())
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <chrono>
+#include <vector>
+
+#include "reader_guid_index.hpp"
+#include "reader_layout.hpp"
 #include "reader_util.hpp"
 
 namespace reader
@@ -12,18 +17,29 @@ public:
 	static const cv::Scalar icon_background;
 
 	
-	static const cv::Rect2f size_framed_icon;
+	/* icon relative to its box, the panes are listed in pane_table */
 	static const cv::Rect2f size_icon;
-	
-	/* pane rectangles relative to [0,1] image */
-	static const cv::Rect2f pane_title;
-	static const cv::Rect2f pane_island;
-	static const cv::Rect2f pane_production_left;
 
 	static const unsigned int count_cols;
 
 };
 
+/*
+* Building counts read so far, allows to continue reading the boxes
+* of the same grid in a later screenshot
+*/
+struct building_progress
+{
+	/* binarized island name of the screenshot the boxes were detected in */
+	cv::Mat island;
+	std::vector<cv::Rect2i> boxes;
+	/* boxes before this index are read */
+	size_t next = 0;
+	guid_values buildings;
+
+	size_t pending() const { return boxes.size() - next; }
+};
+
 /*
 * Stores resolution independent properties of the statistics menu
 * Allows to perform elementary boolean tests
@@ -43,19 +59,26 @@ public:
 	/*
 	* Accessor functions to read data
 	**/
-	std::map < unsigned int, int> get_population_amount() const;
+	guid_values get_population_amount() const;
 
 	/*
 	* Returns percentile productivity for buildings.
 	* Returns an empty map in case no information is found.
 	*/
-	std::map < unsigned int, int> get_average_productivities();
+	guid_values get_average_productivities();
 
 	/*
 	* Returns count of existing buildings (houses/buildings).
 	* Returns an empty map in case no information is found.
 	*/
-	std::map < unsigned int, int> get_assets_existing_buildings();
+	guid_values get_assets_existing_buildings();
+
+	/*
+	* Reads the remaining boxes of @param{progress} one after another until @param{deadline} passes,
+	* but at least one so that repeated calls complete even if the deadline passed already.
+	* Starts over if the progress is complete or was made on another island or grid.
+	*/
+	void read_existing_buildings(building_progress& progress, std::chrono::steady_clock::time_point deadline);
 
 
 	/*
@@ -75,6 +98,8 @@ private:
 	bool open;
 
 	cv::Mat screenshot;
+	/* rectangles of the panes for the size of the last screenshot */
+	std::shared_ptr<const layout_plan> plan;
 
 	// empty if not yet evaluated, use get_selected_island()
 	std::string selected_island;
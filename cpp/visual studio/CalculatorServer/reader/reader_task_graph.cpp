@@ -0,0 +1,159 @@
+#include "reader_task_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "reader_trace.hpp"
+
+namespace reader
+{
+
+////////////////////////////////////////
+//
+// Class: thread_pool
+//
+////////////////////////////////////////
+
+thread_pool::thread_pool(unsigned int threads)
+{
+	for (unsigned int i = 0; i < std::max(1u, threads); i++)
+		workers.emplace_back(&thread_pool::work, this);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobs_changed.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void thread_pool::submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobs_changed.notify_one();
+}
+
+size_t thread_pool::size() const
+{
+	return workers.size();
+}
+
+void thread_pool::work()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobs_changed.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+////////////////////////////////////////
+//
+// Class: task_graph
+//
+////////////////////////////////////////
+
+task_graph::task_id task_graph::add(const char* name, std::function<void()> f, const std::vector<task_id>& dependencies)
+{
+	const task_id id = tasks.size();
+	for (task_id dependency : dependencies)
+	{
+		if (dependency >= id)
+			throw std::invalid_argument("dependencies must be added before their dependents");
+		tasks[dependency].dependents.push_back(id);
+	}
+
+	tasks.push_back(task{ name, std::move(f), {}, dependencies.size() });
+	return id;
+}
+
+void task_graph::run(thread_pool* pool)
+{
+	if (tasks.empty())
+		return;
+
+	if (!pool)
+	{
+		// tasks can only depend on previously added ones, so this order is topological
+		for (const task& t : tasks)
+		{
+			trace_scope scope(t.name);
+			t.f();
+		}
+		return;
+	}
+
+	auto state = std::make_shared<run_state>();
+	state->remaining = tasks.size();
+	for (const task& t : tasks)
+		state->pending.push_back(t.dependency_count);
+
+	for (task_id id = 0; id < tasks.size(); id++)
+		if (!tasks[id].dependency_count)
+			pool->submit([this, id, pool, state]() { execute(id, *pool, state); });
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->remaining == 0; });
+
+	if (state->error)
+		std::rethrow_exception(state->error);
+}
+
+void task_graph::execute(task_id id, thread_pool& pool, const std::shared_ptr<run_state>& state)
+{
+	bool failed;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		failed = static_cast<bool>(state->error);
+	}
+
+	if (!failed)
+	{
+		try {
+			trace_scope scope(tasks[id].name);
+			tasks[id].f();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (!state->error)
+				state->error = std::current_exception();
+		}
+	}
+
+	std::vector<task_id> ready;
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		for (task_id dependent : tasks[id].dependents)
+			if (--state->pending[dependent] == 0)
+				ready.push_back(dependent);
+	}
+
+	for (task_id dependent : ready)
+		pool.submit([this, dependent, &pool, state]() { execute(dependent, pool, state); });
+
+	// decremented last, run() must not return while dependents are being submitted
+	std::lock_guard<std::mutex> lock(state->mutex);
+	if (--state->remaining == 0)
+		state->finished.notify_all();
+}
+
+}
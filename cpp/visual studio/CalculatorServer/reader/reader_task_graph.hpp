@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reader
+{
+
+/*
+* Fixed number of worker threads executing submitted jobs in FIFO order.
+* Queued jobs are finished before the destructor returns.
+*/
+class thread_pool
+{
+public:
+	explicit thread_pool(unsigned int threads);
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	void submit(std::function<void()> job);
+
+	size_t size() const;
+
+private:
+	void work();
+
+	std::mutex mutex;
+	std::condition_variable jobs_changed;
+	std::deque<std::function<void()>> jobs;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+};
+
+/*
+* Stages of a computation with their dependencies, executed on every call of run().
+* Stages whose dependencies are finished run concurrently on a thread pool.
+*/
+class task_graph
+{
+public:
+	typedef size_t task_id;
+
+	/*
+	* Adds a stage that runs after all @param{dependencies} finished
+	* @param{name} must have static storage duration, it is used for tracing
+	*/
+	task_id add(const char* name, std::function<void()> f, const std::vector<task_id>& dependencies = {});
+
+	/*
+	* Executes all stages and returns when they are finished.
+	* Without pool the stages run one after another in the order they were added.
+	* Rethrows the first exception of a stage, the stages not started by then are skipped.
+	*/
+	void run(thread_pool* pool = nullptr);
+
+private:
+	struct task
+	{
+		const char* name;
+		std::function<void()> f;
+		std::vector<task_id> dependents;
+		size_t dependency_count;
+	};
+
+	struct run_state
+	{
+		std::mutex mutex;
+		std::condition_variable finished;
+		/* number of unfinished dependencies per task */
+		std::vector<size_t> pending;
+		size_t remaining;
+		std::exception_ptr error;
+	};
+
+	/*
+	* Runs task @param{id} and submits its dependents that became ready
+	*/
+	void execute(task_id id, thread_pool& pool, const std::shared_ptr<run_state>& state);
+
+	std::vector<task> tasks;
+};
+
+}
@@ -0,0 +1,111 @@
+#include "reader_trace.hpp"
+
+#include <sstream>
+
+namespace reader
+{
+
+////////////////////////////////////////
+//
+// Class: trace
+//
+////////////////////////////////////////
+
+trace::trace()
+	:
+	enabled(false),
+	start(std::chrono::steady_clock::now())
+{
+}
+
+trace& trace::get()
+{
+	static trace instance;
+	return instance;
+}
+
+void trace::begin(const char* name)
+{
+	record(name, 'B');
+}
+
+void trace::end(const char* name)
+{
+	record(name, 'E');
+}
+
+void trace::record(const char* name, char phase)
+{
+	if (!enabled.load(std::memory_order_relaxed))
+		return;
+
+	event e{ name,
+		phase,
+		current_thread_id(),
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() };
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (events.size() < capacity)
+		events.push_back(e);
+	else
+	{
+		events[next] = e;
+		wrapped = true;
+	}
+	next = (next + 1) % capacity;
+}
+
+std::string trace::to_json() const
+{
+	std::vector<event> copy;
+	size_t first;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		copy = events;
+		first = wrapped ? next : 0;
+	}
+
+	std::ostringstream out;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (size_t i = 0; i < copy.size(); i++)
+	{
+		const event& e = copy[(first + i) % copy.size()];
+		if (i)
+			out << ",";
+		out << "{\"name\":\"" << e.name << "\",\"cat\":\"reader\",\"ph\":\"" << e.phase
+			<< "\",\"ts\":" << e.timestamp_us << ",\"pid\":1,\"tid\":" << e.thread_id << "}";
+	}
+	out << "]}";
+
+	return out.str();
+}
+
+unsigned int trace::current_thread_id()
+{
+	static std::atomic<unsigned int> next_id(1);
+	thread_local unsigned int id = next_id.fetch_add(1);
+	return id;
+}
+
+////////////////////////////////////////
+//
+// Class: trace_scope
+//
+////////////////////////////////////////
+
+trace_scope::trace_scope(const char* name)
+	:
+	name(name),
+	active(trace::get().enabled.load(std::memory_order_relaxed))
+{
+	if (active)
+		trace::get().begin(name);
+}
+
+trace_scope::~trace_scope()
+{
+	if (active)
+		trace::get().end(name);
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace reader
+{
+
+/*
+* Records begin and end events of pipeline stages into a ring buffer
+* and exports them in the Chrome trace event format (chrome://tracing, Perfetto).
+* Disabled by default, recording is a no-op then.
+*/
+class trace
+{
+public:
+	struct event
+	{
+		const char* name; // must have static storage duration
+		char phase; // 'B' begin, 'E' end
+		unsigned int thread_id;
+		long long timestamp_us;
+	};
+
+	static trace& get();
+
+	/* number of events kept, older ones are overwritten */
+	static const size_t capacity = 1 << 16;
+
+	void begin(const char* name);
+	void end(const char* name);
+
+	/*
+	* Returns the recorded events as Chrome trace_event JSON
+	*/
+	std::string to_json() const;
+
+	std::atomic<bool> enabled;
+
+private:
+	trace();
+
+	void record(const char* name, char phase);
+
+	/* small sequential ids are easier to read on the timeline than hashed std::thread::ids */
+	static unsigned int current_thread_id();
+
+	const std::chrono::steady_clock::time_point start;
+
+	mutable std::mutex mutex;
+	std::vector<event> events;
+	size_t next = 0;
+	bool wrapped = false;
+};
+
+/*
+* Emits a begin event on construction and an end event on destruction
+*/
+class trace_scope
+{
+public:
+	trace_scope(const char* name);
+	~trace_scope();
+
+	trace_scope(const trace_scope&) = delete;
+	trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+	const char* name;
+	bool active;
+};
+
+}
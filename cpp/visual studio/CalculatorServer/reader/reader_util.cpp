@@ -1,6 +1,8 @@
 ﻿#include "reader_util.hpp"
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <algorithm>
 #include <codecvt>
@@ -8,10 +10,13 @@
 #include <iostream>
 #include <list>
 #include <numeric>
-#include <psapi.h>
 #include <regex>
 #include <stdio.h>
+
+#ifdef _WIN32
+#include <psapi.h>
 #include <tchar.h>
+#endif
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
@@ -24,6 +29,11 @@
 #include <opencv2/imgproc.hpp>
 
 #include <tesseract/genericvector.h>
+#include <tesseract/ocrclass.h>
+#include "reader_assets.hpp"
+#include "reader_debug_images.hpp"
+#include "reader_layout.hpp"
+#include "reader_metrics.hpp"
 #include "reader_statistics_screen.hpp"
 
 
@@ -51,139 +61,27 @@ image_recognition::image_recognition(bool verbose, std::string window_regex)
 	:
 	window_regex(window_regex.empty() ? "A[Nn][Nn][Oo] 1404.*" : std::move(window_regex)),
 	verbose(verbose),
-	ocr(nullptr),
-	ocr_language("english")/*,
+	ocr_language("english"),
+	ocr_timeout(default_ocr_timeout)/*,
 	number_mode(false)*/
 {
-	boost::property_tree::ptree pt;
-	boost::property_tree::read_json("texts/params.json", pt);
-
-	for (const auto& language : pt.get_child("languages"))
-	{
-		std::string key(language.second.get_value<std::string>());
-		keyword_dictionary value;
-		dictionaries.emplace(key, value);
-	}
-
-	std::map<std::string, cv::Mat> icon_tables;
-	for (const auto& icon_map : pt.get_child("icons"))
-	{
-		std::string key(icon_map.second.get_value<std::string>());
-		icon_tables.emplace(key, load_image("icons/" + key));
-	}
-
-	auto load_and_save_icon = [&](unsigned int guid,
-		const boost::property_tree::ptree& asset,
-		std::map<unsigned int, cv::Mat>& container)
-	{
-		if (asset.get_child_optional("icon").has_value())
-		{
-			try
-			{
-				auto config = asset.get_child("icon");
-				auto& icon_map = icon_tables.at(config.get_child("path").get_value<std::string>());
-				int x = config.get_child("x").get_value<int>();
-				int y = config.get_child("y").get_value<int>();
-				int width = config.get_child("width").get_value<int>();
-				int height = config.get_child("height").get_value<int>();
-				
-				cv::Mat icon = icon_map(cv::Rect2i(x,y,width,height));
-				container.emplace(guid, icon);
-
-				if (verbose) {
-					cv::imwrite("debug_images/icon_template.png", icon);
-				}
-			}
-			catch (const std::invalid_argument& e)
-			{
-				std::cout << e.what() << std::endl;
-			}
-		}
-	};
-
-	// load buildings
-	auto process_buildings = [&](const boost::property_tree::ptree& root) {
-		for (const auto& factory : root)
-		{
-			unsigned int guid = factory.second.get_child("guid").get_value<unsigned int>();
-
-			load_and_save_icon(guid, factory.second, building_icons);
-
-			for (const auto& language : factory.second.get_child("locaText"))
-			{
-
-				dictionaries.at(language.first).buildings.emplace(guid, language.second.get_value<std::string>());
-			}
-		}
-	};
-
-	if (verbose) {
-		std::cout << "Load buildings." << std::endl;
-	}
-	process_buildings(pt.get_child("factories"));
-	process_buildings(pt.get_child("residenceBuildings"));
-	process_buildings(pt.get_child("publicBuildings"));
-
-	// load products
-	for (const auto& product : pt.get_child("products"))
-	{
-		unsigned int guid = product.second.get_child("guid").get_value<unsigned int>();
-		if (!product.second.get_child_optional("producers").has_value())
-			continue;
-
-		// store buildings and regions
-		std::vector<unsigned int> factories;
-		for (const auto& factory_entry : product.second.get_child("producers"))
-		{
-			unsigned int factory_id = factory_entry.second.get_value<unsigned int>();
-			factories.push_back(factory_id);
-		}
-		product_to_factories.emplace(guid, std::move(factories));
-
-		for (const auto& language : product.second.get_child("locaText"))
-		{
-			dictionaries.at(language.first).products.emplace(guid, language.second.get_value<std::string>());
-		}
-
-		load_and_save_icon(guid, product.second, product_icons);
-	}
+	if (verbose)
+		debug_image_writer::get().enabled = true;
 
-	if (verbose) {
-		std::cout << "Load population levels." << std::endl;
-	}
-	// load population levels
-	for (const auto& level : pt.get_child("populationLevels"))
-	{
-		unsigned int guid = level.second.get_child("guid").get_value<unsigned int>();
-		load_and_save_icon(guid, level.second, population_icons);
-		for (const auto& language : level.second.get_child("locaText"))
-		{
+	model = assets::load(verbose);
+}
 
-			dictionaries.at(language.first).population_levels.emplace(guid, language.second.get_value<std::string>());
-		}
-	}
+image_recognition::image_recognition(std::shared_ptr<const assets> model, bool verbose, std::string window_regex)
+	:
+	window_regex(window_regex.empty() ? "A[Nn][Nn][Oo] 1404.*" : std::move(window_regex)),
+	verbose(verbose),
+	ocr_language("english"),
+	ocr_timeout(default_ocr_timeout)
+{
+	if (verbose)
+		debug_image_writer::get().enabled = true;
 
-	if (verbose) {
-		std::cout << "Load texts." << std::endl;
-	}
-	pt.clear();
-	if (boost::filesystem::exists("texts/ui_texts.json"))
-	{
-		boost::property_tree::read_json("texts/ui_texts.json", pt);
-		for (const auto& text_node : pt)
-		{
-			std::string language = text_node.first;
-			for (const auto& entry : text_node.second)
-			{
-				unsigned int guid = std::atoi(entry.first.c_str());
-				dictionaries.at(language).ui_texts.emplace(guid, entry.second.get_value<std::string>());
-			}
-		}
-	}
-	else
-	{
-		throw std::runtime_error("ui texts not found");
-	}
+	this->model = std::move(model);
 }
 
 std::string image_recognition::to_string(const std::wstring& str)
@@ -203,21 +101,7 @@ cv::Mat image_recognition::get_square_region(const cv::Mat& img, const cv::Rect2
 	if (!img.size)
 		return cv::Mat();
 
-	float cols = img.cols - 1.f;
-	float rows = img.rows - 1.f;
-	float normal_cols = 16 * rows / 9.f;
-
-	float x = normal_cols * rect.x;
-	if (rect.x + 0.5f * rect.width > 0.66f) // right aligned
-		x = cols - normal_cols + x;
-	else if (rect.x + 0.5f * rect.width > 0.33f) // center aligned
-		x = x - 0.5f * normal_cols + 0.5f * cols;
-
-	int dim = static_cast<int>(std::lround(rect.height * img.rows));
-	cv::Rect scaled(static_cast<int>(x),
-		static_cast<int>(rect.y * img.rows),
-		dim, dim);
-	return img(scaled);
+	return img(layout_plan::resolve_square(relative_rect{ rect.x, rect.y, rect.width, rect.height }, img.size()));
 }
 
 cv::Mat image_recognition::get_cell(const cv::Mat& img, float crop_left, float width, float crop_vertical)
@@ -234,18 +118,7 @@ cv::Mat image_recognition::get_pane(const cv::Rect2f& rect, const cv::Mat& img)
 	if (!img.size)
 		return img;
 
-	float cols = img.cols - 1.f;
-	float rows = img.rows - 1.f;
-	float normal_cols = 16 * rows / 9.f;
-
-	float x = normal_cols * rect.x;
-	if (rect.x + 0.5f * rect.width > 0.66f) // right aligned
-		x = cols - normal_cols + x;
-	else if(rect.x + 0.5f * rect.width > 0.33f) // center aligned
-		x = x - 0.5f * normal_cols + 0.5f * cols;
-	
-	cv::Rect scaled(static_cast<int>(x), static_cast<int>(rect.y * rows), static_cast<int>(rect.width * normal_cols), static_cast<int>(rect.height * rows));
-	return img(scaled);
+	return img(layout_plan::resolve(relative_rect{ rect.x, rect.y, rect.width, rect.height }, img.size()));
 }
 
 bool image_recognition::closer_to(const cv::Scalar& color, const cv::Scalar& ref, const cv::Scalar& other)
@@ -381,10 +254,14 @@ std::vector<unsigned int> image_recognition::get_guid_from_icon(const cv::Mat& i
 	if (icon.empty())
 		return std::vector<unsigned int>();
 
-	cv::Mat background_resized;
-	cv::resize(background, background_resized, cv::Size(icon.cols, icon.rows));
+	scoped_timer timer(stage::ICON_MATCHING);
+
+	// scratch buffers of the calling thread, reallocated only when the icon size changes
+	thread_local cv::Mat background_resized;
+	thread_local cv::Mat template_resized;
+	thread_local cv::Mat diff;
 
-	cv::Mat diff;
+	cv::resize(background, background_resized, cv::Size(icon.cols, icon.rows));
 	cv::absdiff(icon, background_resized, diff);
 	float best_match = static_cast<float>(cv::sum(diff).ddot(cv::Scalar::ones()) / icon.rows / icon.cols);
 	std::vector<unsigned int> guids;
@@ -392,14 +269,12 @@ std::vector<unsigned int> image_recognition::get_guid_from_icon(const cv::Mat& i
 
 	for (auto& entry : dictionary)
 	{
-		cv::Mat template_resized;
 		cv::resize(blend_icon(entry.second, background_resized), template_resized, cv::Size(icon.cols, icon.rows));
 
 #ifdef SHOW_CV_DEBUG_IMAGE_VIEW
 		cv::imwrite("debug_images/icon_template.png", template_resized);
 #endif
 		
-		cv::Mat diff;
 		cv::absdiff(icon, template_resized, diff);
 		float match = cv::sum(diff).ddot(cv::Scalar::ones()) / icon.rows / icon.cols;
 		if (match == best_match)
@@ -418,11 +293,6 @@ std::vector<unsigned int> image_recognition::get_guid_from_icon(const cv::Mat& i
 	if (best_match > 150)
 		return std::vector<unsigned int>();
 
-	if (verbose) {
-		for (unsigned int guid : guids)
-			std::cout << guid << ", ";
-		std::cout << "(" << best_match << ")\t";
-	}
 	return guids;
 }
 
@@ -455,11 +325,6 @@ std::vector<unsigned int> image_recognition::get_guid_from_hu_moments(const cv::
 	//if (best_match > 150)
 	//	return std::vector<unsigned int>();
 
-	if (verbose) {
-		for (unsigned int guid : guids)
-			std::cout << guid << ", ";
-		std::cout << "(" << best_match << ")\t";
-	}
 	return guids;
 }
 
@@ -786,7 +651,7 @@ cv::Mat image_recognition::gamma_invariant_hue_finlayson(const cv::Mat& bgr_in)
 		ret[i] = ret[i] + 2.f;
 		ret[i] = ret[i] / 4.f;
 		ret[i] = ret[i] * 255.f;
-		cv::imwrite("debug_images/ret" + std::to_string(i) + ".png", ret[i]);
+		debug_image_writer::get().write("debug_images/ret" + std::to_string(i) + ".png", ret[i]);
 		//H = (log(R)-log(G))/(log(R)+log(G)-2log(B))
 
 		/*{
@@ -834,13 +699,17 @@ void image_recognition::update(const std::string& language)
 {
 	auto my_language = has_language(language) ? language : "english";
 
+	std::lock_guard<std::mutex> lock(ocr_mutex);
 	update_ocr(my_language/*, number_mode*/);
 
 
 }
 
+#ifdef _WIN32
 cv::Rect2i image_recognition::find_anno()
 {
+	scoped_timer timer(stage::FIND_ANNO);
+
 	try {
 		std::string window_name_regex_string(window_regex);
 		std::regex window_name_regex(window_name_regex_string.data());
@@ -942,6 +811,8 @@ cv::Rect2i image_recognition::get_desktop()
 
 cv::Mat image_recognition::take_screenshot(cv::Rect2i rect)
 {
+	scoped_timer timer(stage::TAKE_SCREENSHOT);
+
 	cv::Rect window = rect;
 
 	if (!rect.area())
@@ -980,26 +851,56 @@ cv::Mat image_recognition::take_screenshot(cv::Rect2i rect)
 	DeleteDC(hwindowCompatibleDC);
 	ReleaseDC(nullptr, hwindowDC);
 
-	if (verbose) {
-		if (!std::filesystem::is_directory("debug_images") || !std::filesystem::exists("debug_images")) { // Check if src folder exists
-			std::filesystem::create_directory("debug_images"); // create src folder
-		}
+	return src;
 
-		cv::imwrite("debug_images/screenshot-" + std::to_string(verbose_screenshot_counter) + ".png", src);
-		if (++verbose_screenshot_counter > 20)
-			verbose_screenshot_counter = 0;
+}
+#else
+/*
+* Window capture requires the Win32 API, other platforms only process image files
+*/
+cv::Rect2i image_recognition::find_anno()
+{
+	scoped_timer timer(stage::FIND_ANNO);
+
+	if (verbose) {
+		std::cout << "Capturing windows is only supported on Windows" << std::endl;
 	}
+	return cv::Rect2i();
+}
 
-	return src;
+cv::Rect2i image_recognition::get_desktop()
+{
+	return cv::Rect2i();
+}
+
+cv::Mat image_recognition::take_screenshot(cv::Rect2i rect)
+{
+	scoped_timer timer(stage::TAKE_SCREENSHOT);
 
+	return cv::Mat();
 }
+#endif
 
 std::vector<std::pair<std::string, cv::Rect>> image_recognition::detect_words(const cv::Mat& in, const tesseract::PageSegMode mode, bool numbers_only)
 {
 	cv::Mat input = in;
 	std::vector<std::pair<std::string, cv::Rect>> ret;
 
-	update_ocr(ocr_language/*, numbers_only*/);
+	std::string language;
+	std::unique_ptr<tesseract::TessBaseAPI> ocr = acquire_ocr(language);
+
+	scoped_timer timer(stage::OCR);
+	metrics::get().increment(counter::OCR_CALLS);
+
+	// checked by the cancel callback, canceled is set when it aborted the call
+	struct ocr_budget
+	{
+		std::chrono::steady_clock::time_point deadline;
+		bool canceled;
+	};
+	const auto start = std::chrono::steady_clock::now();
+	ocr_budget budget = { start + ocr_timeout, false };
+	bool timed_out = false;
 
 	try {
 		const auto& cr = ocr;
@@ -1008,8 +909,21 @@ std::vector<std::pair<std::string, cv::Rect>> image_recognition::detect_words(co
 		// Set image data
 		cr->SetImage(input.data, input.cols, input.rows, 4, input.step);
 
-		cr->Recognize(0);
-		tesseract::ResultIterator* ri = cr->GetIterator();
+		// tesseract polls the deadline and the cancel callback between words
+		tesseract::ETEXT_DESC monitor;
+		monitor.set_deadline_msecs(static_cast<int>(ocr_timeout.count()));
+		monitor.cancel_this = &budget;
+		monitor.cancel = [](void* cancel_this, int) {
+			auto b = static_cast<ocr_budget*>(cancel_this);
+			if (std::chrono::steady_clock::now() >= b->deadline)
+				b->canceled = true;
+			return b->canceled;
+		};
+
+		cr->Recognize(&monitor);
+		timed_out = budget.canceled || monitor.deadline_exceeded();
+
+		tesseract::ResultIterator* ri = timed_out ? nullptr : cr->GetIterator();
 		tesseract::PageIteratorLevel level = tesseract::RIL_WORD;
 
 
@@ -1034,6 +948,15 @@ std::vector<std::pair<std::string, cv::Rect>> image_recognition::detect_words(co
 	}
 	catch (...) {}
 
+	release_ocr(std::move(ocr), language);
+
+	if (timed_out)
+	{
+		metrics::get().increment(counter::OCR_TIMEOUTS);
+		metrics::get().record(stage::OCR_TIMEOUT, std::chrono::steady_clock::now() - start);
+		// no words are returned, the caller treats the crop like an unreadable one
+	}
+
 	return ret;
 }
 
@@ -1041,7 +964,12 @@ std::vector<std::pair<std::string, cv::Rect>> image_recognition::detect_words(co
 
 bool image_recognition::has_language(const std::string& language) const
 {
-	return dictionaries.find(language) != dictionaries.end() && tesseract_languages.find(language) != tesseract_languages.end();
+	std::shared_ptr<const assets> current;
+	{
+		std::lock_guard<std::mutex> lock(model_mutex);
+		current = model;
+	}
+	return current->has_language(language) && tesseract_languages.find(language) != tesseract_languages.end();
 }
 
 bool image_recognition::is_verbose() const
@@ -1049,12 +977,40 @@ bool image_recognition::is_verbose() const
 	return verbose;
 }
 
+const assets& image_recognition::get_assets() const
+{
+	std::lock_guard<std::mutex> lock(model_mutex);
+	return *model;
+}
+
+void image_recognition::set_assets(std::shared_ptr<const assets> model)
+{
+	std::lock_guard<std::mutex> lock(model_mutex);
+	this->model = std::move(model);
+}
+
+void image_recognition::set_ocr_timeout(std::chrono::milliseconds timeout)
+{
+	ocr_timeout = timeout;
+}
+
+std::chrono::milliseconds image_recognition::get_ocr_timeout() const
+{
+	return ocr_timeout;
+}
+
 const keyword_dictionary& image_recognition::get_dictionary() const
 {
-	auto iter = dictionaries.find(ocr_language);
-	if (iter == dictionaries.end())
-		throw std::exception("language not found");
-	return iter->second;
+	std::string language;
+	{
+		std::lock_guard<std::mutex> lock(ocr_mutex);
+		language = ocr_language;
+	}
+
+	const assets& current = get_assets();
+	if (!current.has_language(language))
+		throw std::invalid_argument("language not found");
+	return current.get_dictionary(language);
 }
 
 std::map<unsigned int, std::string>  image_recognition::make_dictionary(const std::vector<phrase>& list) const
@@ -1100,6 +1056,8 @@ std::vector<cv::Rect2i> image_recognition::detect_boxes(const cv::Mat& im, const
 std::vector<cv::Rect2i> image_recognition::detect_boxes(const cv::Mat& im, unsigned int width, unsigned int height, const cv::Rect2i& ignore_region, float tolerance,
 	double threshold1, double threshold2)
 {
+	scoped_timer timer(stage::DETECT_BOXES);
+
 	cv::Mat edge_image;
 	cv::Canny(im, edge_image, threshold1, threshold2, 3);
 	cv::rectangle(edge_image, ignore_region, cv::Scalar::all(0), cv::FILLED);
@@ -1375,17 +1333,35 @@ std::string image_recognition::join(const std::vector<std::pair<std::string, cv:
 
 void image_recognition::update_ocr(const std::string& language/*, bool numbers_only*/)
 {
-	if (ocr && !ocr_language.compare(language) /*&& numbers_only == number_mode*/)
+	if (!ocr_language.compare(language) /*&& numbers_only == number_mode*/)
 		return;
 
 	if (verbose) {
 		std::cout << "Update tesseract language " << language /*<< " number only " << numbers_only*/ << std::endl;
 	}
 
+	// engines in use are dropped when they are released
+	idle_ocr.clear();
+	ocr_language = language;
+	//number_mode = numbers_only;
+}
 
+std::unique_ptr<tesseract::TessBaseAPI> image_recognition::acquire_ocr(std::string& language)
+{
+	{
+		std::lock_guard<std::mutex> lock(ocr_mutex);
+		language = ocr_language;
+		if (!idle_ocr.empty())
+		{
+			std::unique_ptr<tesseract::TessBaseAPI> engine = std::move(idle_ocr.back());
+			idle_ocr.pop_back();
+			return engine;
+		}
+	}
 
+	// initialization loads the trained data, done without holding the lock
 	const char* lang = tesseract_languages.find(language)->second.c_str();
-	ocr.reset(new tesseract::TessBaseAPI());
+	std::unique_ptr<tesseract::TessBaseAPI> ocr(new tesseract::TessBaseAPI());
 
 	GenericVector<STRING> keys;
 	GenericVector<STRING> values;
@@ -1417,9 +1393,14 @@ void image_recognition::update_ocr(const std::string& language/*, bool numbers_o
 	}
 
 	//		ocr_->SetVariable("CONFIGFILE", "bazaar");
-	ocr_language = lang ? language : "english";
-	//number_mode = numbers_only;
+	return ocr;
+}
 
+void image_recognition::release_ocr(std::unique_ptr<tesseract::TessBaseAPI> engine, const std::string& language)
+{
+	std::lock_guard<std::mutex> lock(ocr_mutex);
+	if (!ocr_language.compare(language))
+		idle_ocr.push_back(std::move(engine));
 }
 
 const std::map<std::string, std::string> image_recognition::tesseract_languages = {
@@ -1443,4 +1424,6 @@ const std::map<std::string, std::string> image_recognition::letter_to_digit = {
 
 const std::string image_recognition::ALL_ISLANDS = std::string("All Islands");
 
+const std::chrono::milliseconds image_recognition::default_ocr_timeout = std::chrono::milliseconds(200);
+
 }
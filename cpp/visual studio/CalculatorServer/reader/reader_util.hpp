@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <list>
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <stdexcept>
 #include <string>
 
 #include <opencv2/core/mat.hpp>
@@ -30,6 +33,7 @@ struct keyword_dictionary
 };
 
 class image_recognition;
+class assets;
 
 struct item
 {
@@ -52,12 +56,22 @@ enum class phrase
 	WORLD_STATISTICS = 40110202
 };
 
+/*
+* Recognition context: OCR engines, window capture and options.
+* The game data is an immutable assets model shared between contexts,
+* create one context per recognition that runs in parallel.
+*/
 class image_recognition
 {
 
 public:
 	image_recognition(bool verbose, std::string window_regex = "");
 
+	/*
+	* Uses the already loaded game data @param{model}, e.g. one instance per worker thread
+	*/
+	image_recognition(std::shared_ptr<const assets> model, bool verbose, std::string window_regex = "");
+
 	static std::string to_string(const std::wstring&);
 	static std::wstring to_wstring(const std::string&);
 
@@ -68,6 +82,7 @@ public:
 
 	/*
 	* Returns the region of @param{img} specified by a subregion of [0,1]
+	* Readers of fixed panes use the precomputed rectangles of layout_plan instead.
 	*/
 	static cv::Mat get_pane(const cv::Rect2f& rect, const cv::Mat& img);
 
@@ -211,6 +226,7 @@ public:
 	* detect arbitrary words in the given image [in]
 	*
 	* return a vector of pairs of detected words and their respective bounding box
+	* returns no words if tesseract takes longer than ocr_timeout, the crop is unreadable then
 	*/
 	std::vector<std::pair<std::string, cv::Rect>>  detect_words(
 		const cv::Mat& in,
@@ -225,12 +241,19 @@ public:
 	std::string join(const std::vector<std::pair<std::string, cv::Rect>>& words, bool insert_sapces = false) const;
 
 	/**
-	* access to the singleton TessBaseAPI instance
+	* TessBaseAPI instances for ocr_language, detect_words takes an idle one or creates
+	* a new one, so that concurrent stages of a recognition do not wait for each other
 	*/
 	//@{
 	void update_ocr(const std::string& language/*, bool numbers_only = false*/);
-	std::shared_ptr<tesseract::TessBaseAPI> ocr;
+	/* @param{language} is set to the language of the returned engine */
+	std::unique_ptr<tesseract::TessBaseAPI> acquire_ocr(std::string& language);
+	/* engines of a language that is no longer selected are dropped */
+	void release_ocr(std::unique_ptr<tesseract::TessBaseAPI> engine, const std::string& language);
+	std::vector<std::unique_ptr<tesseract::TessBaseAPI>> idle_ocr;
 	std::string ocr_language;
+	/* guards idle_ocr and ocr_language */
+	mutable std::mutex ocr_mutex;
 	//bool number_mode;
 	//@}
 
@@ -248,6 +271,25 @@ public:
 	*/
 	const keyword_dictionary& get_dictionary() const;
 
+	/*
+	* Game data (dictionaries, icons) loaded on construction
+	* The reference stays valid until the next call to set_assets
+	*/
+	const assets& get_assets() const;
+
+	/*
+	* Replaces the game data, e.g. after the files changed
+	* Must not be called while a recognition is running, warm state like the OCR engine is kept
+	*/
+	void set_assets(std::shared_ptr<const assets> model);
+
+	/*
+	* Maximal duration of a single tesseract call, default_ocr_timeout unless set
+	* Must not be called while a recognition is running
+	*/
+	void set_ocr_timeout(std::chrono::milliseconds timeout);
+	std::chrono::milliseconds get_ocr_timeout() const;
+
 	/*
 	* Compose custom dictionary from phrases
 	*/
@@ -298,23 +340,22 @@ public:
 	static const std::string ALL_ISLANDS;
 
 	bool verbose;
-	int verbose_screenshot_counter = 0;
 
 	typedef std::vector<double> hu_moments;
 
 	std::string window_regex;
 
-	std::map<std::string, keyword_dictionary> dictionaries;
-	std::map<unsigned int, cv::Mat> product_icons;
-	std::map<unsigned int, cv::Mat> building_icons;
-	std::map<unsigned int, cv::Mat> population_icons;
-
-	std::map<unsigned int, std::vector<unsigned int>> product_to_factories;
-	std::map<unsigned int, std::set<unsigned int>> trader_to_offerings;
-	std::map<unsigned int, item::ptr> items;
-	std::map<unsigned int, cv::Mat> item_backgrounds;
+	mutable std::mutex model_mutex;
+	/* dictionaries and icons, shared with other instances, replaced by set_assets, guarded by model_mutex */
+	std::shared_ptr<const assets> model;
 
 	static const std::map<std::string, std::string> tesseract_languages;
+
+	/* keeps the latency bounded for unreadable crops */
+	static const std::chrono::milliseconds default_ocr_timeout;
+
+	/* maximal duration of a single tesseract call */
+	std::chrono::milliseconds ocr_timeout;
 };
 
 }
\ No newline at end of file